@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class Executor;
+
+/**
+ * parks threads waiting for completions, notified by worker jobs when they finish,
+ * completions that can not notify such as device events are covered by bounded waits with backoff
+ */
+class Wakeup {
+public:
+    static Wakeup& global() {
+        static Wakeup wakeup;
+        return wakeup;
+    }
+
+    uint64_t epoch() {
+        std::lock_guard< std::mutex > lock( mutex );
+        return counter;
+    }
+
+    void notify() {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            counter++;
+        }
+        condition.notify_all();
+    }
+
+    /**
+     * waits until notified after epoch seen was read or until timeout
+     */
+    void wait( uint64_t seen, std::chrono::microseconds timeout ) {
+        std::unique_lock< std::mutex > lock( mutex );
+        condition.wait_for( lock, timeout, [&] { return counter != seen; } );
+    }
+
+    static constexpr std::chrono::microseconds min_backoff{ 20 };
+    static constexpr std::chrono::microseconds max_backoff{ 1000 };
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    uint64_t counter = 0;
+};
+
+/**
+ * awaitable completion of asynchronous device work, ready is polled by executor,
+ * error is read once ready and its exception is rethrown to the awaiting side
+ */
+class Completion {
+public:
+    explicit Completion( std::function< bool() > ready, std::function< std::exception_ptr() > error = nullptr )
+            : ready( std::move( ready ) ), error( std::move( error ) ) {}
+
+    bool done() const {
+        return ready();
+    }
+
+    bool await_ready() const {
+        return ready();
+    }
+
+    /**
+     * parks coroutine on current executor, awaiting outside of Executor::run blocks instead
+     */
+    bool await_suspend( std::coroutine_handle<> handle ) const;
+
+    void await_resume() const {
+        rethrow();
+    }
+
+    /**
+     * blocks calling thread, for use outside of coroutines
+     */
+    void wait() const {
+        block();
+        rethrow();
+    }
+
+private:
+    void block() const {
+        auto& wakeup = Wakeup::global();
+        auto backoff = Wakeup::min_backoff;
+        while ( true ) {
+            auto seen = wakeup.epoch();
+            if ( ready() )
+                return;
+            wakeup.wait( seen, backoff );
+            backoff = std::min( backoff * 2, Wakeup::max_backoff );
+        }
+    }
+
+    void rethrow() const {
+        if ( !error )
+            return;
+        if ( auto exception = error() )
+            std::rethrow_exception( exception );
+    }
+
+    std::function< bool() > ready;
+    std::function< std::exception_ptr() > error;
+};
+
+/**
+ * detached coroutine started by executor
+ */
+class Task {
+public:
+    struct promise_type {
+        Task get_return_object() {
+            return Task( std::coroutine_handle< promise_type >::from_promise( *this ) );
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        /**
+         * frame is destroyed at final suspend, so exception is handed to executor and rethrown from run
+         */
+        void unhandled_exception();
+    };
+
+    explicit Task( std::coroutine_handle< promise_type > handle ) : handle( handle ) {}
+
+    Task( Task&& other ) noexcept : handle( std::exchange( other.handle, nullptr ) ) {}
+
+    Task( const Task& ) = delete;
+    Task& operator=( const Task& ) = delete;
+
+    ~Task() {
+        if ( handle )
+            handle.destroy();
+    }
+
+    std::coroutine_handle<> release() {
+        return std::exchange( handle, nullptr );
+    }
+
+private:
+    std::coroutine_handle< promise_type > handle;
+};
+
+/**
+ * single threaded coroutine executor, resumes tasks whose completions became ready
+ */
+class Executor {
+public:
+    Executor() = default;
+    Executor( const Executor& ) = delete;
+    Executor& operator=( const Executor& ) = delete;
+
+    ~Executor() {
+        for ( auto handle : ready )
+            handle.destroy();
+        for ( auto& entry : waiting )
+            entry.handle.destroy();
+    }
+
+    static Executor*& current() {
+        static thread_local Executor* executor = nullptr;
+        return executor;
+    }
+
+    void spawn( Task task ) {
+        ready.push_back( task.release() );
+    }
+
+    void suspend( std::coroutine_handle<> handle, const Completion* completion ) {
+        waiting.push_back( Waiting{ handle, completion } );
+    }
+
+    void fail( std::exception_ptr exception ) {
+        if ( !error )
+            error = exception;
+    }
+
+    /**
+     * runs until all spawned tasks are finished, parks between polls while all tasks wait,
+     * rethrows first exception escaping a task, remaining tasks are destroyed with executor
+     */
+    void run() {
+        auto previous = std::exchange( current(), this );
+        auto& wakeup = Wakeup::global();
+        auto backoff = Wakeup::min_backoff;
+        while ( !ready.empty() || !waiting.empty() ) {
+            while ( !ready.empty() ) {
+                auto handle = ready.front();
+                ready.pop_front();
+                handle.resume();
+                if ( error ) {
+                    current() = previous;
+                    std::rethrow_exception( std::exchange( error, nullptr ) );
+                }
+            }
+
+            auto seen = wakeup.epoch();
+
+            for ( size_t i = 0; i < waiting.size(); ) {
+                if ( waiting[ i ].completion->done() ) {
+                    ready.push_back( waiting[ i ].handle );
+                    waiting[ i ] = waiting.back();
+                    waiting.pop_back();
+                } else {
+                    i++;
+                }
+            }
+
+            if ( ready.empty() && !waiting.empty() ) {
+                wakeup.wait( seen, backoff );
+                backoff = std::min( backoff * 2, Wakeup::max_backoff );
+            } else {
+                backoff = Wakeup::min_backoff;
+            }
+        }
+        current() = previous;
+    }
+
+private:
+    struct Waiting {
+        std::coroutine_handle<> handle;
+        const Completion* completion;
+    };
+
+    std::deque< std::coroutine_handle<> > ready;
+    std::vector< Waiting > waiting;
+    std::exception_ptr error;
+};
+
+inline bool Completion::await_suspend( std::coroutine_handle<> handle ) const {
+    auto executor = Executor::current();
+    if ( !executor ) {
+        block();
+        return false;
+    }
+    executor->suspend( handle, this );
+    return true;
+}
+
+inline void Task::promise_type::unhandled_exception() {
+    auto executor = Executor::current();
+    assert( executor && "tasks are resumed only by Executor::run" );
+    executor->fail( std::current_exception() );
+}
+
+/**
+ * host thread serializing blocking device jobs, so that callers only poll completions
+ */
+class Worker {
+public:
+    Worker() : stopped( false ), thread( [this] { loop(); } ) {}
+
+    Worker( const Worker& ) = delete;
+    Worker& operator=( const Worker& ) = delete;
+
+    ~Worker() {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            stopped = true;
+        }
+        condition.notify_one();
+        thread.join();
+    }
+
+    /**
+     * queues job, exception thrown by job is kept and rethrown from wait or co_await of returned completion
+     */
+    template< typename Job >
+    Completion submit( Job&& job ) {
+        auto state = std::make_shared< JobState >();
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            jobs.push_back( [job = std::forward< Job >( job ), state]() mutable {
+                try {
+                    job();
+                } catch ( ... ) {
+                    state->error = std::current_exception();
+                }
+                state->finished.store( true, std::memory_order_release );
+                Wakeup::global().notify();
+            } );
+        }
+        condition.notify_one();
+        return Completion( [state] { return state->finished.load( std::memory_order_acquire ); },
+                [state] { return state->error; } );
+    }
+
+private:
+    /**
+     * error is written before finished is released and read only after finished is acquired
+     */
+    struct JobState {
+        std::atomic< bool > finished{ false };
+        std::exception_ptr error;
+    };
+
+    void loop() {
+        while ( true ) {
+            std::function< void() > job;
+            {
+                std::unique_lock< std::mutex > lock( mutex );
+                condition.wait( lock, [this] { return stopped || !jobs.empty(); } );
+                if ( jobs.empty() )
+                    return;
+                job = std::move( jobs.front() );
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque< std::function< void() > > jobs;
+    bool stopped;
+    std::thread thread;
+};
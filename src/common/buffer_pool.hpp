@@ -0,0 +1,225 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+constexpr std::size_t cache_line_size = 64;
+constexpr std::size_t huge_page_size = 2 << 20;
+constexpr std::size_t default_max_cached = std::size_t( 1 ) << 30;
+constexpr std::size_t max_reuse_ratio = 2;
+
+/**
+ *
+ */
+struct Block {
+    void* address;
+    std::size_t capacity;
+    bool mapped;
+
+    static Block create( std::size_t size ) {
+        if ( size < huge_page_size ) {
+            auto capacity = align( size, cache_line_size );
+            auto address = std::aligned_alloc( cache_line_size, capacity );
+            if ( !address )
+                throw std::bad_alloc();
+            return Block{ address, capacity, false };
+        }
+
+        auto capacity = align( size, huge_page_size );
+#ifdef MAP_HUGETLB
+        {
+            // explicit huge pages, available only if reserved in /proc/sys/vm/nr_hugepages
+            auto address = mmap( nullptr, capacity, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0 );
+            if ( address != MAP_FAILED )
+                return Block{ address, capacity, true };
+        }
+#endif
+        // transparent huge pages, mapping is over-allocated to trim it to huge page boundary
+        auto reserved = capacity + huge_page_size;
+        auto address = mmap( nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( address == MAP_FAILED )
+            throw std::bad_alloc();
+
+        auto head = reinterpret_cast< std::uintptr_t >( address );
+        auto aligned = align( head, huge_page_size );
+        if ( aligned > head )
+            munmap( address, aligned - head );
+        if ( aligned + capacity < head + reserved )
+            munmap( reinterpret_cast< void* >( aligned + capacity ), head + reserved - aligned - capacity );
+
+        address = reinterpret_cast< void* >( aligned );
+#ifdef MADV_HUGEPAGE
+        madvise( address, capacity, MADV_HUGEPAGE );
+#endif
+#ifdef MADV_POPULATE_WRITE
+        madvise( address, capacity, MADV_POPULATE_WRITE );
+#endif
+        return Block{ address, capacity, true };
+    }
+
+    static std::size_t align( std::size_t size, std::size_t alignment ) {
+        return ( size + alignment - 1 ) / alignment * alignment;
+    }
+
+    void destroy() {
+        if ( mapped )
+            munmap( address, capacity );
+        else
+            std::free( address );
+    }
+};
+
+class BufferPool;
+
+/**
+ * owning handle of pooled memory, returns block to the pool on destruction
+ */
+template< typename Scalar >
+class PoolBuffer {
+public:
+    PoolBuffer() : pool( nullptr ), block{ nullptr, 0, false }, count( 0 ) {}
+
+    PoolBuffer( BufferPool* pool, Block block, std::size_t count ) : pool( pool ), block( block ), count( count ) {}
+
+    PoolBuffer( PoolBuffer&& other ) noexcept : PoolBuffer() {
+        swap( other );
+    }
+
+    PoolBuffer& operator=( PoolBuffer&& other ) noexcept {
+        swap( other );
+        return *this;
+    }
+
+    PoolBuffer( const PoolBuffer& ) = delete;
+    PoolBuffer& operator=( const PoolBuffer& ) = delete;
+
+    ~PoolBuffer();
+
+    void swap( PoolBuffer& other ) noexcept {
+        std::swap( pool, other.pool );
+        std::swap( block, other.block );
+        std::swap( count, other.count );
+    }
+
+    Scalar* data() const {
+        return static_cast< Scalar* >( block.address );
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    Scalar& operator[]( std::size_t i ) const {
+        return data()[ i ];
+    }
+
+    Scalar* begin() const {
+        return data();
+    }
+
+    Scalar* end() const {
+        return data() + count;
+    }
+
+private:
+    BufferPool* pool;
+    Block block;
+    std::size_t count;
+};
+
+/**
+ * recycles aligned point buffers between batches, older free blocks above max_cached bytes are returned to the system,
+ * the most recently released block is always kept so one buffer larger than the cap is still recycled
+ */
+class BufferPool {
+public:
+    explicit BufferPool( std::size_t max_cached = default_max_cached ) : max_cached( max_cached ), cached( 0 ) {}
+    BufferPool( const BufferPool& ) = delete;
+    BufferPool& operator=( const BufferPool& ) = delete;
+
+    ~BufferPool() {
+        for ( auto& block : blocks )
+            block.destroy();
+    }
+
+    static BufferPool& global() {
+        static BufferPool pool;
+        return pool;
+    }
+
+    /**
+     * takes smallest free block fitting count elements and at most max_reuse_ratio times larger or allocates new one,
+     * memory content is not initialized
+     */
+    template< typename Scalar >
+    PoolBuffer< Scalar > acquire( std::size_t count ) {
+        auto size = count * sizeof( Scalar );
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            auto best = blocks.end();
+            for ( auto it = blocks.begin(); it != blocks.end(); ++it )
+                if ( it->capacity >= size && it->capacity <= size * max_reuse_ratio &&
+                        ( best == blocks.end() || it->capacity < best->capacity ) )
+                    best = it;
+
+            if ( best != blocks.end() ) {
+                auto block = *best;
+                cached -= block.capacity;
+                blocks.erase( best );
+                return PoolBuffer< Scalar >( this, block, count );
+            }
+        }
+        return PoolBuffer< Scalar >( this, Block::create( size ), count );
+    }
+
+    /**
+     * caches block for reuse, oldest other free blocks are unmapped while cache exceeds max_cached bytes
+     */
+    void release( Block block ) {
+        std::vector< Block > evicted;
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            blocks.push_back( block );
+            cached += block.capacity;
+            auto count = std::size_t( 0 );
+            while ( cached > max_cached && count + 1 < blocks.size() ) {
+                cached -= blocks[ count ].capacity;
+                count++;
+            }
+            evicted.assign( blocks.begin(), blocks.begin() + count );
+            blocks.erase( blocks.begin(), blocks.begin() + count );
+        }
+        for ( auto& block : evicted )
+            block.destroy();
+    }
+
+    /**
+     * returns memory of all free blocks to the system
+     */
+    void trim() {
+        std::lock_guard< std::mutex > lock( mutex );
+        for ( auto& block : blocks )
+            block.destroy();
+        blocks.clear();
+        cached = 0;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector< Block > blocks;
+    std::size_t max_cached;
+    std::size_t cached;
+};
+
+template< typename Scalar >
+PoolBuffer< Scalar >::~PoolBuffer() {
+    if ( pool && block.address )
+        pool->release( block );
+}
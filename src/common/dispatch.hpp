@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+/**
+ * linear cost of a transform path, seconds = overhead + per_point * count
+ */
+struct CostModel {
+    double overhead;
+    double per_point;
+
+    /**
+     * fits model to two timed runs, run is called with point count and must block until done
+     */
+    template< typename Run >
+    static CostModel measure( Run&& run, uint32_t small_count, uint32_t large_count, int repeats = 3 ) {
+        auto time = [&]( uint32_t count ) {
+            run( count );
+            double best = std::numeric_limits< double >::max();
+            for ( int r = 0; r < repeats; r++ ) {
+                auto timer = std::chrono::steady_clock::now();
+                run( count );
+                auto seconds = std::chrono::duration_cast< std::chrono::duration< double > >(
+                        std::chrono::steady_clock::now() - timer ).count();
+                best = seconds < best ? seconds : best;
+            }
+            return best;
+        };
+
+        auto small_time = time( small_count );
+        auto large_time = time( large_count );
+        CostModel model;
+        model.per_point = std::max( ( large_time - small_time ) / ( large_count - small_count ), 0. );
+        model.overhead = std::max( small_time - model.per_point * small_count, 0. );
+        return model;
+    }
+
+    double predict( uint32_t count ) const {
+        return overhead + per_point * count;
+    }
+};
+
+/**
+ * smallest batch from which device path is predicted to be faster than host path for all larger batches,
+ * device with lower overhead but higher per point cost is faster only below the intersection, which a lower bound
+ * cannot express, so max is returned for it and callers should compare predict of both models instead
+ */
+inline uint32_t crossover( const CostModel& host, const CostModel& device ) {
+    if ( device.overhead <= host.overhead )
+        return device.per_point <= host.per_point ? 0 : std::numeric_limits< uint32_t >::max();
+    if ( device.per_point >= host.per_point )
+        return std::numeric_limits< uint32_t >::max();
+
+    auto count = ( device.overhead - host.overhead ) / ( host.per_point - device.per_point );
+    return count < std::numeric_limits< uint32_t >::max() ? uint32_t( count ) + 1 : std::numeric_limits< uint32_t >::max();
+}
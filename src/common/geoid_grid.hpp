@@ -0,0 +1,128 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * header of tiled geoid grid file, followed by tiles of tile_size x tile_size float undulations,
+ * tiles and nodes inside them are stored row by row, rows go from lat0 northward, columns from lon0 eastward
+ */
+struct GeoidHeader {
+    char magic[ 8 ];
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t tile_size;
+    uint32_t reserved;
+    double lon0;
+    double lat0;
+    double step;
+    char padding[ 16 ];
+
+    uint32_t tile_rows() const {
+        return ( rows + tile_size - 1 ) / tile_size;
+    }
+
+    uint32_t tile_cols() const {
+        return ( cols + tile_size - 1 ) / tile_size;
+    }
+
+    size_t node_count() const {
+        return size_t( tile_rows() ) * tile_cols() * tile_size * tile_size;
+    }
+};
+
+static_assert( sizeof( GeoidHeader ) == 64, "tiles must start at cache line boundary" );
+
+constexpr char geoid_magic[ 8 ] = { 'G', 'E', 'O', 'I', 'D', 'T', 'L', '1' };
+
+/**
+ * read-only memory mapping of tiled geoid grid file
+ */
+class GeoidGrid {
+public:
+    explicit GeoidGrid( const std::string& path ) {
+        int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+        if ( fd < 0 )
+            throw std::runtime_error( "geoid " + path + ": " + std::strerror( errno ) );
+
+        struct stat info;
+        if ( fstat( fd, &info ) < 0 || size_t( info.st_size ) < sizeof( GeoidHeader ) ) {
+            close( fd );
+            throw std::runtime_error( "geoid " + path + ": file is too short" );
+        }
+
+        length = info.st_size;
+        address = mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+        close( fd );
+        if ( address == MAP_FAILED )
+            throw std::runtime_error( "geoid " + path + ": " + std::strerror( errno ) );
+
+        auto& header = this->header();
+        if ( std::memcmp( header.magic, geoid_magic, sizeof( geoid_magic ) ) != 0 || header.tile_size == 0 ||
+                header.rows == 0 || header.cols == 0 || !( header.step > 0 ) ||
+                length < sizeof( GeoidHeader ) + header.node_count() * sizeof( float ) ) {
+            munmap( address, length );
+            throw std::runtime_error( "geoid " + path + ": not a tiled geoid grid" );
+        }
+        madvise( address, length, MADV_WILLNEED );
+    }
+
+    GeoidGrid( const GeoidGrid& ) = delete;
+    GeoidGrid& operator=( const GeoidGrid& ) = delete;
+
+    ~GeoidGrid() {
+        munmap( address, length );
+    }
+
+    const GeoidHeader& header() const {
+        return *static_cast< const GeoidHeader* >( address );
+    }
+
+    const float* nodes() const {
+        return reinterpret_cast< const float* >( static_cast< const char* >( address ) + sizeof( GeoidHeader ) );
+    }
+
+    /**
+     * converts row-major grid of rows x cols undulations to tiled file
+     */
+    static void write( const std::string& path, const float* grid, uint32_t rows, uint32_t cols,
+            double lon0, double lat0, double step, uint32_t tile_size = 32 ) {
+        GeoidHeader header;
+        std::memset( &header, 0, sizeof( header ) );
+        std::memcpy( header.magic, geoid_magic, sizeof( geoid_magic ) );
+        header.rows = rows;
+        header.cols = cols;
+        header.tile_size = tile_size;
+        header.lon0 = lon0;
+        header.lat0 = lat0;
+        header.step = step;
+
+        std::vector< float > tiles( header.node_count(), 0.f );
+        for ( uint32_t row = 0; row < rows; row++ ) {
+            for ( uint32_t col = 0; col < cols; col++ ) {
+                auto tile = size_t( row / tile_size ) * header.tile_cols() + col / tile_size;
+                auto index = ( tile * tile_size + row % tile_size ) * tile_size + col % tile_size;
+                tiles[ index ] = grid[ size_t( row ) * cols + col ];
+            }
+        }
+
+        std::ofstream file( path, std::ios::binary );
+        file.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+        file.write( reinterpret_cast< const char* >( tiles.data() ), tiles.size() * sizeof( float ) );
+        if ( !file )
+            throw std::runtime_error( "geoid " + path + ": write failed" );
+    }
+
+private:
+    void* address;
+    size_t length;
+};
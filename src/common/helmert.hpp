@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cmath>
+
+/**
+ * 14 parameter helmert transformation in position vector convention,
+ * translations in metres, rotations in arcseconds, scale in ppb, rates per year and epochs in decimal years,
+ * 7 parameter transformation has zero rates
+ */
+struct HelmertConfig {
+    double tx;
+    double ty;
+    double tz;
+    double rx;
+    double ry;
+    double rz;
+    double scale;
+    double rate_tx;
+    double rate_ty;
+    double rate_tz;
+    double rate_rx;
+    double rate_ry;
+    double rate_rz;
+    double rate_scale;
+    double reference_epoch;
+
+    static HelmertConfig create() {
+        HelmertConfig config;
+        config.tx = 0;
+        config.ty = 0;
+        config.tz = 0;
+        config.rx = 0;
+        config.ry = 0;
+        config.rz = 0;
+        config.scale = 0;
+        config.rate_tx = 0;
+        config.rate_ty = 0;
+        config.rate_tz = 0;
+        config.rate_rx = 0;
+        config.rate_ry = 0;
+        config.rate_rz = 0;
+        config.rate_scale = 0;
+        config.reference_epoch = 2010;
+        return config;
+    }
+
+    /**
+     * reverse transformation with negated parameters, exact to first order in small parameters
+     */
+    HelmertConfig inverse() const {
+        HelmertConfig config = *this;
+        config.tx = -tx;
+        config.ty = -ty;
+        config.tz = -tz;
+        config.rx = -rx;
+        config.ry = -ry;
+        config.rz = -rz;
+        config.scale = -scale;
+        config.rate_tx = -rate_tx;
+        config.rate_ty = -rate_ty;
+        config.rate_tz = -rate_tz;
+        config.rate_rx = -rate_rx;
+        config.rate_ry = -rate_ry;
+        config.rate_rz = -rate_rz;
+        config.rate_scale = -rate_scale;
+        return config;
+    }
+};
+
+/**
+ * helmert transformation of epsg:4978 coordinates with precomputed matrices,
+ * x' = x + translation + rotation * x, where rotation holds scale and rotation angles without identity
+ */
+struct Helmert {
+    double translation[ 3 ];
+    double rotation[ 9 ];
+    double translation_rate[ 3 ];
+    double rotation_rate[ 9 ];
+    double reference_epoch;
+
+    /**
+     * translations and their rates are divided by scale_factor of georef the same way as ellipsoid radii
+     */
+    static Helmert create( const HelmertConfig& config, double scale_factor ) {
+        constexpr double arcsecond = M_PI / 180. / 3600.;
+        constexpr double ppb = 1e-9;
+
+        Helmert helmert;
+        matrix( helmert.translation, helmert.rotation,
+                config.tx / scale_factor, config.ty / scale_factor, config.tz / scale_factor,
+                config.rx * arcsecond, config.ry * arcsecond, config.rz * arcsecond, config.scale * ppb );
+        matrix( helmert.translation_rate, helmert.rotation_rate,
+                config.rate_tx / scale_factor, config.rate_ty / scale_factor, config.rate_tz / scale_factor,
+                config.rate_rx * arcsecond, config.rate_ry * arcsecond, config.rate_rz * arcsecond, config.rate_scale * ppb );
+        helmert.reference_epoch = config.reference_epoch;
+        return helmert;
+    }
+
+    /**
+     * 7 parameter transformation propagated to epoch
+     */
+    Helmert at( double epoch ) const {
+        auto dt = epoch - reference_epoch;
+        Helmert helmert;
+        for ( int i = 0; i < 3; i++ ) {
+            helmert.translation[ i ] = translation[ i ] + translation_rate[ i ] * dt;
+            helmert.translation_rate[ i ] = 0;
+        }
+        for ( int i = 0; i < 9; i++ ) {
+            helmert.rotation[ i ] = rotation[ i ] + rotation_rate[ i ] * dt;
+            helmert.rotation_rate[ i ] = 0;
+        }
+        helmert.reference_epoch = epoch;
+        return helmert;
+    }
+
+    /**
+     * transformation at reference epoch
+     */
+    template< typename Object >
+    const Helmert& apply( Object& object ) const {
+        auto x = object.x();
+        auto y = object.y();
+        auto z = object.z();
+        object.x() = x + translation[ 0 ] + rotation[ 0 ] * x + rotation[ 1 ] * y + rotation[ 2 ] * z;
+        object.y() = y + translation[ 1 ] + rotation[ 3 ] * x + rotation[ 4 ] * y + rotation[ 5 ] * z;
+        object.z() = z + translation[ 2 ] + rotation[ 6 ] * x + rotation[ 7 ] * y + rotation[ 8 ] * z;
+        return *this;
+    }
+
+    /**
+     * transformation at epoch of point
+     */
+    template< typename Object >
+    const Helmert& apply( Object& object, double epoch ) const {
+        auto dt = epoch - reference_epoch;
+        auto x = object.x();
+        auto y = object.y();
+        auto z = object.z();
+        object.x() = x + ( translation[ 0 ] + translation_rate[ 0 ] * dt ) + ( rotation[ 0 ] + rotation_rate[ 0 ] * dt ) * x +
+                ( rotation[ 1 ] + rotation_rate[ 1 ] * dt ) * y + ( rotation[ 2 ] + rotation_rate[ 2 ] * dt ) * z;
+        object.y() = y + ( translation[ 1 ] + translation_rate[ 1 ] * dt ) + ( rotation[ 3 ] + rotation_rate[ 3 ] * dt ) * x +
+                ( rotation[ 4 ] + rotation_rate[ 4 ] * dt ) * y + ( rotation[ 5 ] + rotation_rate[ 5 ] * dt ) * z;
+        object.z() = z + ( translation[ 2 ] + translation_rate[ 2 ] * dt ) + ( rotation[ 6 ] + rotation_rate[ 6 ] * dt ) * x +
+                ( rotation[ 7 ] + rotation_rate[ 7 ] * dt ) * y + ( rotation[ 8 ] + rotation_rate[ 8 ] * dt ) * z;
+        return *this;
+    }
+
+private:
+    static void matrix( double* translation, double* rotation, double tx, double ty, double tz,
+            double rx, double ry, double rz, double scale ) {
+        translation[ 0 ] = tx;
+        translation[ 1 ] = ty;
+        translation[ 2 ] = tz;
+        rotation[ 0 ] = scale;
+        rotation[ 1 ] = -rz;
+        rotation[ 2 ] = ry;
+        rotation[ 3 ] = rz;
+        rotation[ 4 ] = scale;
+        rotation[ 5 ] = -rx;
+        rotation[ 6 ] = -ry;
+        rotation[ 7 ] = rx;
+        rotation[ 8 ] = scale;
+    }
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/**
+ * runs fn( begin, end ) over count items split between threads, small counts run on calling thread only
+ */
+template< typename Fn >
+void parallel_ranges( uint32_t count, uint32_t threads, Fn&& fn ) {
+    threads = std::max( 1u, std::min( threads, count / 4096 + 1 ) );
+    std::vector< std::thread > workers;
+    for ( uint32_t t = 1; t < threads; t++ )
+        workers.emplace_back( [&, t] { fn( uint64_t( count ) * t / threads, uint64_t( count ) * ( t + 1 ) / threads ); } );
+    fn( 0, count / threads );
+    for ( auto& worker : workers )
+        worker.join();
+}
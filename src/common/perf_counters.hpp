@@ -0,0 +1,90 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+
+/**
+ *
+ */
+struct PerfSample {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cache_misses;
+    uint64_t branch_misses;
+
+    double ipc() const {
+        return cycles ? double( instructions ) / cycles : 0;
+    }
+};
+
+/**
+ * hardware counters of the calling thread read through perf_event_open,
+ * counters stay unavailable when kernel.perf_event_paranoid forbids them
+ */
+class PerfCounters {
+public:
+    PerfCounters() {
+        uint64_t configs[ event_count ] = {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES,
+                PERF_COUNT_HW_BRANCH_MISSES };
+
+        for ( int i = 0; i < event_count; i++ ) {
+            perf_event_attr attr;
+            std::memset( &attr, 0, sizeof( attr ) );
+            attr.size = sizeof( attr );
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[ i ];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            descriptors[ i ] = syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+        }
+    }
+
+    PerfCounters( const PerfCounters& ) = delete;
+    PerfCounters& operator=( const PerfCounters& ) = delete;
+
+    ~PerfCounters() {
+        for ( auto fd : descriptors )
+            if ( fd >= 0 )
+                close( fd );
+    }
+
+    bool available() const {
+        for ( auto fd : descriptors )
+            if ( fd < 0 )
+                return false;
+        return true;
+    }
+
+    void start() {
+        for ( auto fd : descriptors ) {
+            if ( fd >= 0 ) {
+                ioctl( fd, PERF_EVENT_IOC_RESET, 0 );
+                ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+            }
+        }
+    }
+
+    PerfSample stop() {
+        uint64_t values[ event_count ] = {};
+        for ( int i = 0; i < event_count; i++ ) {
+            if ( descriptors[ i ] >= 0 ) {
+                ioctl( descriptors[ i ], PERF_EVENT_IOC_DISABLE, 0 );
+                if ( read( descriptors[ i ], &values[ i ], sizeof( uint64_t ) ) != sizeof( uint64_t ) )
+                    values[ i ] = 0;
+            }
+        }
+        return PerfSample{ values[ 0 ], values[ 1 ], values[ 2 ], values[ 3 ] };
+    }
+
+private:
+    static constexpr int event_count = 4;
+    int descriptors[ event_count ];
+};
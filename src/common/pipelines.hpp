@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+
+#include <helmert.hpp>
+
+/**
+ * pipeline epsg:4326 to epsg:5819
+ */
+struct Geod2Topo {
+    template< typename Georef, typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.geod2ecef( object ).ecef2topo( object );
+    }
+};
+
+/**
+ * pipeline epsg:5819 to epsg:4326
+ */
+struct Topo2Geod {
+    template< typename Georef, typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.topo2ecef( object ).ecef2geod( object );
+    }
+};
+
+/**
+ * pipeline epsg:4326 to epsg:5819 and back
+ */
+struct RoundTrip {
+    template< typename Georef, typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.geod2ecef( object ).ecef2topo( object ).topo2ecef( object ).ecef2geod( object );
+    }
+};
+
+/**
+ * pipeline epsg:4326 with orthometric height to epsg:5819
+ */
+template< typename Geoid >
+struct OrthoGeod2Topo {
+    Geoid geoid;
+
+    template< typename Georef, typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.geod2ecef( object, geoid ).ecef2topo( object );
+    }
+};
+
+template< typename Geoid >
+OrthoGeod2Topo( Geoid ) -> OrthoGeod2Topo< Geoid >;
+
+/**
+ * pipeline epsg:5819 to epsg:4326 with orthometric height
+ */
+template< typename Geoid >
+struct OrthoTopo2Geod {
+    Geoid geoid;
+
+    template< typename Georef, typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.topo2ecef( object ).ecef2geod( object, geoid );
+    }
+};
+
+template< typename Geoid >
+OrthoTopo2Geod( Geoid ) -> OrthoTopo2Geod< Geoid >;
+
+/**
+ * pipeline epsg:4326 with orthometric height to epsg:5819 and back
+ */
+template< typename Geoid >
+struct OrthoRoundTrip {
+    Geoid geoid;
+
+    template< typename Georef, typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.geod2ecef( object, geoid ).ecef2topo( object ).topo2ecef( object ).ecef2geod( object, geoid );
+    }
+};
+
+template< typename Geoid >
+OrthoRoundTrip( Geoid ) -> OrthoRoundTrip< Geoid >;
+
+/**
+ * pipeline epsg:4326 in source datum to epsg:5819 in target datum,
+ * epoch of point i is read from epochs[ i ] when set, helmert is applied at its reference epoch otherwise
+ */
+struct HelmertGeod2Topo {
+    Helmert helmert;
+    const double* epochs;
+
+    template< typename Georef, typename Object >
+    void operator()( Georef& georef, Object& object, uint32_t i ) const {
+        georef.geod2ecef( object );
+        if ( epochs )
+            georef.ecef2ecef( object, helmert, epochs[ i ] );
+        else
+            georef.ecef2ecef( object, helmert );
+        georef.ecef2topo( object );
+    }
+};
+
+/**
+ * pipeline epsg:5819 in target datum to epsg:4326 in source datum, helmert is the inverse one
+ */
+struct HelmertTopo2Geod {
+    Helmert helmert;
+    const double* epochs;
+
+    template< typename Georef, typename Object >
+    void operator()( Georef& georef, Object& object, uint32_t i ) const {
+        georef.topo2ecef( object );
+        if ( epochs )
+            georef.ecef2ecef( object, helmert, epochs[ i ] );
+        else
+            georef.ecef2ecef( object, helmert );
+        georef.ecef2geod( object );
+    }
+};
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <parallel.hpp>
+
+/**
+ * uniform grid over points stored as x[count] y[count] z[count] with occupied cells sorted in morton order,
+ * index does not own points, they must stay alive and unchanged while index is used
+ */
+class SpatialIndex {
+public:
+    /**
+     * cell size 0 selects cell with about eight points on average over bounding box volume,
+     * any cell size is raised so that no axis has more than max_cells cells
+     */
+    static SpatialIndex build( const double* data, uint32_t count, double cell_size = 0,
+            uint32_t threads = std::max( std::thread::hardware_concurrency(), 1u ) ) {
+        SpatialIndex index;
+        index.data = data;
+        index.count = count;
+
+        double lo[ 3 ], hi[ 3 ];
+        std::fill( lo, lo + 3, std::numeric_limits< double >::infinity() );
+        std::fill( hi, hi + 3, -std::numeric_limits< double >::infinity() );
+        std::mutex mutex;
+        parallel_ranges( count, threads, [&]( uint32_t begin, uint32_t end ) {
+            for ( int axis = 0; axis < 3; axis++ ) {
+                auto range = std::minmax_element( data + begin + size_t( count ) * axis, data + end + size_t( count ) * axis );
+                if ( begin == end )
+                    continue;
+                std::lock_guard< std::mutex > lock( mutex );
+                lo[ axis ] = std::min( lo[ axis ], *range.first );
+                hi[ axis ] = std::max( hi[ axis ], *range.second );
+            }
+        } );
+
+        double extent[ 3 ];
+        for ( int axis = 0; axis < 3; axis++ ) {
+            index.origin[ axis ] = count ? lo[ axis ] : 0;
+            extent[ axis ] = count ? hi[ axis ] - lo[ axis ] : 0;
+        }
+
+        double volume = 1;
+        double longest = 0;
+        for ( int axis = 0; axis < 3; axis++ ) {
+            volume *= std::max( extent[ axis ], 1e-9 );
+            longest = std::max( longest, extent[ axis ] );
+        }
+        if ( cell_size <= 0 ) {
+            cell_size = std::cbrt( volume / std::max( count / 8., 1. ) );
+            cell_size = cell_size > 0 ? cell_size : 1;
+        }
+        // cells are never clamped at the far edge, so shell pruning in nearest sees true cell distances
+        index.cell_size = std::max( cell_size, longest / max_cells );
+        for ( int axis = 0; axis < 3; axis++ )
+            index.dims[ axis ] = std::min( int64_t( extent[ axis ] / cell_size ) + 1, int64_t( max_cells ) );
+
+        std::vector< std::pair< uint64_t, uint32_t > > keys( count );
+        parallel_ranges( count, threads, [&]( uint32_t begin, uint32_t end ) {
+            for ( auto i = begin; i < end; i++ )
+                keys[ i ] = { index.code( index.cell( data[ i ], data[ i + count ], data[ i + size_t( count ) * 2 ] ) ), i };
+        } );
+        parallel_sort( keys, threads );
+
+        index.order.resize( count );
+        parallel_ranges( count, threads, [&]( uint32_t begin, uint32_t end ) {
+            for ( auto i = begin; i < end; i++ )
+                index.order[ i ] = keys[ i ].second;
+        } );
+
+        for ( uint32_t i = 0; i < count; i++ ) {
+            if ( i == 0 || keys[ i ].first != keys[ i - 1 ].first ) {
+                index.codes.push_back( keys[ i ].first );
+                index.starts.push_back( i );
+            }
+        }
+        index.starts.push_back( count );
+        return index;
+    }
+
+    /**
+     * permutes points into morton order for locality of later passes, queries then return new positions
+     */
+    void reorder( double* points, uint32_t threads = std::max( std::thread::hardware_concurrency(), 1u ) ) {
+        std::vector< double > copy( points, points + size_t( count ) * 3 );
+        parallel_ranges( count, threads, [&]( uint32_t begin, uint32_t end ) {
+            for ( auto i = begin; i < end; i++ ) {
+                for ( int axis = 0; axis < 3; axis++ )
+                    points[ i + size_t( count ) * axis ] = copy[ order[ i ] + size_t( count ) * axis ];
+                order[ i ] = i;
+            }
+        } );
+        data = points;
+    }
+
+    /**
+     * indices of points inside axis aligned box [ lo, hi ]
+     */
+    std::vector< uint32_t > box( const double lo[ 3 ], const double hi[ 3 ] ) const {
+        std::vector< uint32_t > found;
+        visit( cell( lo[ 0 ], lo[ 1 ], lo[ 2 ] ), cell( hi[ 0 ], hi[ 1 ], hi[ 2 ] ), [&]( uint32_t i ) {
+            if ( inside( i, lo, hi ) )
+                found.push_back( i );
+        } );
+        return found;
+    }
+
+    /**
+     * indices of points within radius of center
+     */
+    std::vector< uint32_t > radius( const double center[ 3 ], double radius ) const {
+        std::vector< uint32_t > found;
+        double lo[ 3 ] = { center[ 0 ] - radius, center[ 1 ] - radius, center[ 2 ] - radius };
+        double hi[ 3 ] = { center[ 0 ] + radius, center[ 1 ] + radius, center[ 2 ] + radius };
+        visit( cell( lo[ 0 ], lo[ 1 ], lo[ 2 ] ), cell( hi[ 0 ], hi[ 1 ], hi[ 2 ] ), [&]( uint32_t i ) {
+            if ( distance2( i, center ) <= radius * radius )
+                found.push_back( i );
+        } );
+        return found;
+    }
+
+    /**
+     * indices of k points nearest to center ordered by distance,
+     * cells are scanned in growing shells clipped to grid until k-th distance is below next shell distance,
+     * once a shell would have more cells than are occupied the remaining occupied cells are scanned by distance
+     */
+    std::vector< uint32_t > nearest( const double center[ 3 ], uint32_t k ) const {
+        std::priority_queue< std::pair< double, uint32_t > > heap;
+        k = std::min( k, count );
+        if ( k == 0 )
+            return {};
+
+        Cell middle;
+        for ( int axis = 0; axis < 3; axis++ )
+            middle.index[ axis ] = int64_t( std::floor( ( center[ axis ] - origin[ axis ] ) / cell_size ) );
+
+        int64_t reach = 0;
+        for ( int axis = 0; axis < 3; axis++ )
+            reach = std::max( { reach, middle.index[ axis ], dims[ axis ] - 1 - middle.index[ axis ] } );
+
+        auto consider = [&]( uint32_t i ) {
+            auto distance = distance2( i, center );
+            if ( heap.size() < k ) {
+                heap.push( { distance, i } );
+            } else if ( distance < heap.top().first ) {
+                heap.pop();
+                heap.push( { distance, i } );
+            }
+        };
+        auto full = [&]( double bound ) {
+            return heap.size() == k && heap.top().first <= bound * bound;
+        };
+
+        // shells up to ring - 1 are scanned when loop stops at shell size guard,
+        // so points of ring itself can be as close as ( ring - 1 ) * cell_size
+        bool settled = false;
+        int64_t ring = 0;
+        for ( ; ring <= reach; ring++ ) {
+            auto side = 2 * ring + 1;
+            if ( ring > 0 && uint64_t( side * side * side - ( side - 2 ) * ( side - 2 ) * ( side - 2 ) ) > codes.size() )
+                break;
+
+            int64_t lo[ 3 ], hi[ 3 ];
+            for ( int axis = 0; axis < 3; axis++ ) {
+                lo[ axis ] = std::max( -ring, -middle.index[ axis ] );
+                hi[ axis ] = std::min( ring, dims[ axis ] - 1 - middle.index[ axis ] );
+            }
+            for ( auto dx = lo[ 0 ]; dx <= hi[ 0 ]; dx++ ) {
+                for ( auto dy = lo[ 1 ]; dy <= hi[ 1 ]; dy++ ) {
+                    auto scan = [&]( int64_t dz ) {
+                        points( code( Cell{ { middle.index[ 0 ] + dx, middle.index[ 1 ] + dy, middle.index[ 2 ] + dz } } ), consider );
+                    };
+                    if ( std::abs( dx ) == ring || std::abs( dy ) == ring ) {
+                        for ( auto dz = lo[ 2 ]; dz <= hi[ 2 ]; dz++ )
+                            scan( dz );
+                    } else {
+                        if ( lo[ 2 ] == -ring )
+                            scan( -ring );
+                        if ( hi[ 2 ] == ring && ring > 0 )
+                            scan( ring );
+                    }
+                }
+            }
+
+            if ( full( ring * cell_size ) ) {
+                settled = true;
+                break;
+            }
+        }
+
+        if ( ring <= reach && !settled ) {
+            std::vector< std::pair< double, size_t > > remaining;
+            for ( size_t slot = 0; slot < codes.size(); slot++ ) {
+                auto cell = decode( codes[ slot ] );
+                int64_t distance = 0;
+                double bound = 0;
+                for ( int axis = 0; axis < 3; axis++ ) {
+                    distance = std::max( distance, std::abs( cell.index[ axis ] - middle.index[ axis ] ) );
+                    auto lo = origin[ axis ] + cell.index[ axis ] * cell_size;
+                    auto gap = std::max( { lo - center[ axis ], center[ axis ] - lo - cell_size, 0. } );
+                    bound += gap * gap;
+                }
+                if ( distance >= ring )
+                    remaining.push_back( { bound, slot } );
+            }
+            std::sort( remaining.begin(), remaining.end() );
+
+            for ( auto& [ bound, slot ] : remaining ) {
+                if ( heap.size() == k && heap.top().first <= bound )
+                    break;
+                for ( auto i = starts[ slot ]; i < starts[ slot + 1 ]; i++ )
+                    consider( order[ i ] );
+            }
+        }
+
+        std::vector< uint32_t > found( heap.size() );
+        for ( auto i = found.size(); i > 0; i-- ) {
+            found[ i - 1 ] = heap.top().second;
+            heap.pop();
+        }
+        return found;
+    }
+
+    size_t cell_count() const {
+        return codes.size();
+    }
+
+private:
+    static constexpr int64_t max_cells = 1 << 21;
+
+    struct Cell {
+        int64_t index[ 3 ];
+    };
+
+    Cell cell( double x, double y, double z ) const {
+        double point[ 3 ] = { x, y, z };
+        Cell cell;
+        for ( int axis = 0; axis < 3; axis++ ) {
+            auto index = int64_t( std::floor( ( point[ axis ] - origin[ axis ] ) / cell_size ) );
+            cell.index[ axis ] = std::clamp( index, int64_t( 0 ), dims[ axis ] - 1 );
+        }
+        return cell;
+    }
+
+    bool contains( const Cell& cell ) const {
+        for ( int axis = 0; axis < 3; axis++ )
+            if ( cell.index[ axis ] < 0 || cell.index[ axis ] >= dims[ axis ] )
+                return false;
+        return true;
+    }
+
+    static uint64_t spread( uint64_t value ) {
+        value &= 0x1fffff;
+        value = ( value | value << 32 ) & 0x1f00000000ffffull;
+        value = ( value | value << 16 ) & 0x1f0000ff0000ffull;
+        value = ( value | value << 8 ) & 0x100f00f00f00f00full;
+        value = ( value | value << 4 ) & 0x10c30c30c30c30c3ull;
+        value = ( value | value << 2 ) & 0x1249249249249249ull;
+        return value;
+    }
+
+    static uint64_t compact( uint64_t value ) {
+        value &= 0x1249249249249249ull;
+        value = ( value | value >> 2 ) & 0x10c30c30c30c30c3ull;
+        value = ( value | value >> 4 ) & 0x100f00f00f00f00full;
+        value = ( value | value >> 8 ) & 0x1f0000ff0000ffull;
+        value = ( value | value >> 16 ) & 0x1f00000000ffffull;
+        value = ( value | value >> 32 ) & 0x1fffff;
+        return value;
+    }
+
+    static Cell decode( uint64_t key ) {
+        return Cell{ { int64_t( compact( key ) ), int64_t( compact( key >> 1 ) ), int64_t( compact( key >> 2 ) ) } };
+    }
+
+    static uint64_t code( const Cell& cell ) {
+        return spread( cell.index[ 0 ] ) | spread( cell.index[ 1 ] ) << 1 | spread( cell.index[ 2 ] ) << 2;
+    }
+
+    template< typename Fn >
+    void points( uint64_t key, Fn&& fn ) const {
+        auto it = std::lower_bound( codes.begin(), codes.end(), key );
+        if ( it == codes.end() || *it != key )
+            return;
+        auto slot = it - codes.begin();
+        for ( auto i = starts[ slot ]; i < starts[ slot + 1 ]; i++ )
+            fn( order[ i ] );
+    }
+
+    template< typename Fn >
+    void visit( const Cell& lo, const Cell& hi, Fn&& fn ) const {
+        for ( auto z = lo.index[ 2 ]; z <= hi.index[ 2 ]; z++ )
+            for ( auto y = lo.index[ 1 ]; y <= hi.index[ 1 ]; y++ )
+                for ( auto x = lo.index[ 0 ]; x <= hi.index[ 0 ]; x++ )
+                    points( code( Cell{ { x, y, z } } ), fn );
+    }
+
+    bool inside( uint32_t i, const double lo[ 3 ], const double hi[ 3 ] ) const {
+        for ( int axis = 0; axis < 3; axis++ ) {
+            auto value = data[ i + size_t( count ) * axis ];
+            if ( value < lo[ axis ] || value > hi[ axis ] )
+                return false;
+        }
+        return true;
+    }
+
+    double distance2( uint32_t i, const double center[ 3 ] ) const {
+        double sum = 0;
+        for ( int axis = 0; axis < 3; axis++ ) {
+            auto delta = data[ i + size_t( count ) * axis ] - center[ axis ];
+            sum += delta * delta;
+        }
+        return sum;
+    }
+
+    /**
+     * chunks are sorted by separate threads and merged pairwise
+     */
+    static void parallel_sort( std::vector< std::pair< uint64_t, uint32_t > >& keys, uint32_t threads ) {
+        auto size = uint32_t( keys.size() );
+        threads = std::max( 1u, std::min( threads, size / 4096 + 1 ) );
+        std::vector< uint32_t > bounds;
+        for ( uint32_t t = 0; t <= threads; t++ )
+            bounds.push_back( uint64_t( size ) * t / threads );
+
+        std::vector< std::thread > sorters;
+        for ( uint32_t t = 0; t < threads; t++ )
+            sorters.emplace_back( [&, t] { std::sort( keys.begin() + bounds[ t ], keys.begin() + bounds[ t + 1 ] ); } );
+        for ( auto& sorter : sorters )
+            sorter.join();
+
+        for ( uint32_t step = 1; step < threads; step *= 2 ) {
+            std::vector< std::thread > workers;
+            for ( uint32_t t = 0; t + step < threads; t += step * 2 ) {
+                auto first = keys.begin() + bounds[ t ];
+                auto middle = keys.begin() + bounds[ t + step ];
+                auto last = keys.begin() + bounds[ std::min( t + step * 2, threads ) ];
+                workers.emplace_back( [=] { std::inplace_merge( first, middle, last ); } );
+            }
+            for ( auto& worker : workers )
+                worker.join();
+        }
+    }
+
+    const double* data;
+    uint32_t count;
+    double origin[ 3 ];
+    double cell_size;
+    int64_t dims[ 3 ];
+    std::vector< uint64_t > codes;
+    std::vector< uint32_t > starts;
+    std::vector< uint32_t > order;
+};
+
+/**
+ * compares box and nearest queries around sampled points with brute force on index built over at most limit
+ * evenly strided points of data, before and after reorder, returns number of mismatches
+ */
+inline uint32_t check_spatial_index( const double* data, uint32_t count, uint32_t limit = 100'000,
+        double half_width = 50'000 ) {
+    auto stride = count / std::max( limit, 1u ) + 1;
+    uint32_t size = count ? ( count - 1 ) / stride + 1 : 0;
+    std::vector< double > subset( size_t( size ) * 3 );
+    for ( uint32_t i = 0; i < size; i++ )
+        for ( int axis = 0; axis < 3; axis++ )
+            subset[ i + size_t( size ) * axis ] = data[ size_t( i ) * stride + size_t( count ) * axis ];
+
+    auto index = SpatialIndex::build( subset.data(), size );
+    auto check = [&]() {
+        uint32_t mismatches = 0;
+        std::vector< double > distances( size );
+        for ( uint32_t sample = 0; sample < size; sample += size / 8 + 1 ) {
+            double center[ 3 ], lo[ 3 ], hi[ 3 ];
+            for ( int axis = 0; axis < 3; axis++ ) {
+                center[ axis ] = subset[ sample + size_t( size ) * axis ] + half_width / 10;
+                lo[ axis ] = center[ axis ] - half_width;
+                hi[ axis ] = center[ axis ] + half_width;
+            }
+
+            uint32_t inside = 0;
+            for ( uint32_t i = 0; i < size; i++ ) {
+                double distance = 0;
+                bool contained = true;
+                for ( int axis = 0; axis < 3; axis++ ) {
+                    auto value = subset[ i + size_t( size ) * axis ];
+                    distance += ( value - center[ axis ] ) * ( value - center[ axis ] );
+                    contained = contained && value >= lo[ axis ] && value <= hi[ axis ];
+                }
+                distances[ i ] = distance;
+                inside += contained;
+            }
+            mismatches += index.box( lo, hi ).size() != inside;
+
+            auto k = std::min( size, 16u );
+            auto nearest = index.nearest( center, k );
+            std::nth_element( distances.begin(), distances.begin() + k - 1, distances.end() );
+            double farthest = 0;
+            for ( int axis = 0; axis < 3; axis++ ) {
+                auto delta = subset[ nearest.back() + size_t( size ) * axis ] - center[ axis ];
+                farthest += delta * delta;
+            }
+            mismatches += nearest.size() != k || farthest != distances[ k - 1 ];
+        }
+        return mismatches;
+    };
+
+    auto mismatches = check();
+    index.reorder( subset.data() );
+    return mismatches + check();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+/**
+ * per-axis bounds and sums of transformed points, filled by kernel reductions or by add and merge on host
+ */
+struct Statistics {
+    double min[ 3 ];
+    double max[ 3 ];
+    double sum[ 3 ];
+    uint64_t count;
+
+    static Statistics create() {
+        Statistics statistics;
+        for ( int axis = 0; axis < 3; axis++ ) {
+            statistics.min[ axis ] = std::numeric_limits< double >::infinity();
+            statistics.max[ axis ] = -std::numeric_limits< double >::infinity();
+            statistics.sum[ axis ] = 0;
+        }
+        statistics.count = 0;
+        return statistics;
+    }
+
+    void add( const double point[ 3 ] ) {
+        for ( int axis = 0; axis < 3; axis++ ) {
+            min[ axis ] = std::min( min[ axis ], point[ axis ] );
+            max[ axis ] = std::max( max[ axis ], point[ axis ] );
+            sum[ axis ] += point[ axis ];
+        }
+        count++;
+    }
+
+    void merge( const Statistics& other ) {
+        for ( int axis = 0; axis < 3; axis++ ) {
+            min[ axis ] = std::min( min[ axis ], other.min[ axis ] );
+            max[ axis ] = std::max( max[ axis ], other.max[ axis ] );
+            sum[ axis ] += other.sum[ axis ];
+        }
+        count += other.count;
+    }
+
+    double centroid( int axis ) const {
+        return count ? sum[ axis ] / count : 0;
+    }
+
+    double extent( int axis ) const {
+        return max[ axis ] - min[ axis ];
+    }
+};
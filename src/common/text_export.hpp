@@ -0,0 +1,211 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ *
+ */
+struct ExportConfig {
+    static constexpr int max_precision = 17;
+
+    int precision;
+    char delimiter;
+    uint32_t chunk_points;
+    uint32_t threads;
+
+    static ExportConfig create() {
+        ExportConfig config;
+        config.precision = 3;
+        config.delimiter = ',';
+        config.chunk_points = 1 << 16;
+        config.threads = std::max( std::thread::hardware_concurrency(), 1u );
+        return config;
+    }
+
+    /**
+     * throws if precision is outside [ 0, max_precision ] or chunk is empty
+     */
+    void validate() const {
+        if ( precision < 0 || precision > max_precision )
+            throw std::invalid_argument( "export: precision must be in 0.." + std::to_string( max_precision ) );
+        if ( chunk_points == 0 )
+            throw std::invalid_argument( "export: chunk must not be empty" );
+    }
+};
+
+/**
+ * writes points stored as x[count] y[count] z[count] as text lines "x,y,z",
+ * chunks are formatted with std::to_chars by worker threads and written in order by calling thread
+ */
+class TextExporter {
+public:
+    explicit TextExporter( const ExportConfig& config ) : config( config ) {
+        config.validate();
+    }
+
+    void write( const std::string& path, const double* data, uint32_t count ) {
+        int fd = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+        if ( fd < 0 )
+            throw std::runtime_error( "export " + path + ": " + std::strerror( errno ) );
+        try {
+            write( fd, data, count );
+        } catch ( ... ) {
+            close( fd );
+            throw;
+        }
+        close( fd );
+    }
+
+    void write( int fd, const double* data, uint32_t count ) {
+        auto chunk_count = ( count + config.chunk_points - 1 ) / config.chunk_points;
+        auto window = std::max( config.threads * 2, 1u );
+        slots.assign( window, Slot{} );
+        next_chunk = 0;
+        written_chunk = 0;
+        failed = false;
+        failure = 0;
+
+        std::vector< std::thread > workers;
+        for ( uint32_t t = 0; t < std::min( config.threads, chunk_count ); t++ )
+            workers.emplace_back( [&] { format( data, count, chunk_count ); } );
+
+        bool error = false;
+        int code = 0;
+        for ( uint32_t chunk = 0; chunk < chunk_count && !error; chunk++ ) {
+            auto& slot = slots[ chunk % window ];
+            {
+                std::unique_lock< std::mutex > lock( mutex );
+                condition.wait( lock, [&] { return slot.ready || failed; } );
+                if ( !slot.ready ) {
+                    error = true;
+                    code = failure;
+                    break;
+                }
+            }
+
+            size_t offset = 0;
+            while ( offset < slot.text.size() ) {
+                auto size = ::write( fd, slot.text.data() + offset, slot.text.size() - offset );
+                if ( size < 0 && errno == EINTR )
+                    continue;
+                if ( size < 0 ) {
+                    error = true;
+                    code = errno;
+                    break;
+                }
+                offset += size;
+            }
+
+            {
+                std::lock_guard< std::mutex > lock( mutex );
+                slot.ready = false;
+                written_chunk = chunk + 1;
+            }
+            condition.notify_all();
+        }
+
+        if ( error ) {
+            std::lock_guard< std::mutex > lock( mutex );
+            failed = true;
+            written_chunk = chunk_count;
+        }
+        condition.notify_all();
+        for ( auto& worker : workers )
+            worker.join();
+        if ( error )
+            throw std::runtime_error( "export: " + std::string( std::strerror( code ) ) );
+    }
+
+private:
+    struct Slot {
+        std::vector< char > text;
+        bool ready = false;
+    };
+
+    /**
+     * worker loop, chunk is formatted only after chunk - window has been written to reuse its slot
+     */
+    void format( const double* data, uint32_t count, uint32_t chunk_count ) {
+        // sign, 20 integer digits, point, precision digits and delimiter per coordinate
+        auto line_size = size_t( 3 ) * ( 24 + config.precision );
+        auto window = uint32_t( slots.size() );
+
+        while ( true ) {
+            uint32_t chunk;
+            {
+                std::unique_lock< std::mutex > lock( mutex );
+                if ( next_chunk >= chunk_count || failed )
+                    return;
+                chunk = next_chunk++;
+                condition.wait( lock, [&] { return chunk < written_chunk + window; } );
+                if ( failed )
+                    return;
+            }
+
+            auto& slot = slots[ chunk % window ];
+            auto begin = chunk * config.chunk_points;
+            auto end = std::min( begin + config.chunk_points, count );
+            slot.text.resize( line_size * ( end - begin ) );
+
+            auto cursor = slot.text.data();
+            auto limit = slot.text.data() + slot.text.size();
+            for ( auto i = begin; i < end; i++ ) {
+                cursor = put( cursor, limit, data[ i ], config.delimiter );
+                cursor = put( cursor, limit, data[ i + count ], config.delimiter );
+                cursor = put( cursor, limit, data[ i + size_t( count ) * 2 ], '\n' );
+            }
+            if ( !cursor ) {
+                std::lock_guard< std::mutex > lock( mutex );
+                failed = true;
+                failure = EOVERFLOW;
+                condition.notify_all();
+                return;
+            }
+            slot.text.resize( cursor - slot.text.data() );
+
+            {
+                std::lock_guard< std::mutex > lock( mutex );
+                slot.ready = true;
+            }
+            condition.notify_all();
+        }
+    }
+
+    /**
+     * writes value followed by separator, fixed notation, values out of its 20 digit budget and non-finite ones
+     * are written in scientific notation, returns nullptr once text does not fit
+     */
+    char* put( char* cursor, char* limit, double value, char separator ) const {
+        if ( !cursor )
+            return nullptr;
+        auto result = value > -1e20 && value < 1e20 ?
+                std::to_chars( cursor, limit, value, std::chars_format::fixed, config.precision ) :
+                std::to_chars( cursor, limit, value, std::chars_format::scientific, std::min( config.precision, 16 ) );
+        if ( result.ec != std::errc() || result.ptr == limit )
+            return nullptr;
+        *result.ptr = separator;
+        return result.ptr + 1;
+    }
+
+    ExportConfig config;
+    std::vector< Slot > slots;
+    std::mutex mutex;
+    std::condition_variable condition;
+    uint32_t next_chunk;
+    uint32_t written_chunk;
+    bool failed;
+    int failure;
+};
@@ -0,0 +1,374 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <buffer_pool.hpp>
+
+/**
+ *
+ */
+struct ServerConfig {
+    std::string socket_path;
+    uint32_t max_batch;
+    std::chrono::microseconds deadline;
+
+    static ServerConfig create() {
+        ServerConfig config;
+        config.socket_path = "/tmp/offload_test.sock";
+        config.max_batch = 1 << 20;
+        config.deadline = std::chrono::microseconds( 200 );
+        return config;
+    }
+};
+
+/**
+ * transform service over unix domain socket,
+ * request is uint32 point count followed by count x y z triples of doubles,
+ * response has the same layout with transformed points,
+ * small requests are grouped into one batch until max_batch points or deadline since the oldest request
+ */
+class TransformServer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TransformServer( const ServerConfig& config ) : config( config ), listener( -1 ), pending_points( 0 ) {
+        if ( pipe2( wakeup, O_NONBLOCK | O_CLOEXEC ) < 0 )
+            throw std::runtime_error( "pipe: " + std::string( std::strerror( errno ) ) );
+
+        listener = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+        if ( listener < 0 ) {
+            close( wakeup[ 0 ] );
+            close( wakeup[ 1 ] );
+            throw std::runtime_error( "socket: " + std::string( std::strerror( errno ) ) );
+        }
+
+        sockaddr_un address;
+        std::memset( &address, 0, sizeof( address ) );
+        address.sun_family = AF_UNIX;
+        if ( config.socket_path.size() >= sizeof( address.sun_path ) ) {
+            close( listener );
+            close( wakeup[ 0 ] );
+            close( wakeup[ 1 ] );
+            throw std::runtime_error( "socket path is too long: " + config.socket_path );
+        }
+        std::strcpy( address.sun_path, config.socket_path.c_str() );
+
+        unlink( config.socket_path.c_str() );
+        if ( bind( listener, reinterpret_cast< sockaddr* >( &address ), sizeof( address ) ) < 0 ||
+                listen( listener, SOMAXCONN ) < 0 ) {
+            close( listener );
+            close( wakeup[ 0 ] );
+            close( wakeup[ 1 ] );
+            throw std::runtime_error( "bind: " + std::string( std::strerror( errno ) ) );
+        }
+    }
+
+    TransformServer( const TransformServer& ) = delete;
+    TransformServer& operator=( const TransformServer& ) = delete;
+
+    ~TransformServer() {
+        for ( auto& it : clients )
+            close( it.first );
+        close( listener );
+        close( wakeup[ 0 ] );
+        close( wakeup[ 1 ] );
+        unlink( config.socket_path.c_str() );
+    }
+
+    /**
+     * serves until stop or SIGINT / SIGTERM, kernel( data, count ) transforms count points stored as x[count] y[count] z[count],
+     * data is the same buffer of max_batch x y z triples for the whole run, so it can be mapped to device once
+     */
+    template< typename Kernel >
+    void run( Kernel&& kernel ) {
+        auto batch = BufferPool::global().acquire< double >( size_t( config.max_batch ) * 3 );
+        SignalScope signals( wakeup[ 1 ] );
+
+        std::vector< pollfd > fds;
+        while ( true ) {
+            fds.clear();
+            fds.push_back( pollfd{ listener, POLLIN, 0 } );
+            fds.push_back( pollfd{ wakeup[ 0 ], POLLIN, 0 } );
+            for ( auto& it : clients ) {
+                short events = it.second.closed ? 0 : POLLIN;
+                fds.push_back( pollfd{ it.first, short( it.second.output.empty() ? events : events | POLLOUT ), 0 } );
+            }
+
+            // ppoll keeps sub-millisecond deadline precision
+            timespec timeout{ 0, 0 };
+            if ( !pending.empty() ) {
+                auto left = std::chrono::duration_cast< std::chrono::nanoseconds >(
+                        pending.front().arrival + config.deadline - Clock::now() ).count();
+                if ( left > 0 )
+                    timeout = timespec{ time_t( left / 1'000'000'000 ), long( left % 1'000'000'000 ) };
+            }
+
+            if ( ppoll( fds.data(), fds.size(), pending.empty() ? nullptr : &timeout, nullptr ) < 0 && errno != EINTR )
+                throw std::runtime_error( "poll: " + std::string( std::strerror( errno ) ) );
+
+            if ( fds[ 1 ].revents & POLLIN )
+                break;
+
+            if ( fds[ 0 ].revents & POLLIN )
+                accept_clients();
+
+            for ( size_t i = 2; i < fds.size(); i++ ) {
+                if ( fds[ i ].revents & ( POLLERR | POLLHUP | POLLNVAL ) && !( fds[ i ].revents & POLLIN ) )
+                    drop_client( fds[ i ].fd );
+                else if ( fds[ i ].revents & POLLIN && !receive( fds[ i ].fd ) )
+                    drop_client( fds[ i ].fd );
+                else if ( fds[ i ].revents & POLLOUT && !send( fds[ i ].fd ) )
+                    drop_client( fds[ i ].fd );
+                else if ( fds[ i ].revents )
+                    retire_client( fds[ i ].fd );
+            }
+
+            while ( !pending.empty() && ( pending_points >= config.max_batch ||
+                    Clock::now() >= pending.front().arrival + config.deadline ) )
+                process( kernel, batch );
+        }
+
+        char drain[ 64 ];
+        while ( read( wakeup[ 0 ], drain, sizeof( drain ) ) > 0 ) {}
+    }
+
+    /**
+     * makes run return after current iteration, safe to call from other threads
+     */
+    void stop() {
+        notify( wakeup[ 1 ] );
+    }
+
+private:
+    /**
+     * routes SIGINT and SIGTERM to wakeup pipe of running server and restores previous handlers on exit
+     */
+    class SignalScope {
+    public:
+        explicit SignalScope( int fd ) {
+            target() = fd;
+            struct sigaction action;
+            std::memset( &action, 0, sizeof( action ) );
+            action.sa_handler = []( int ) {
+                auto saved = errno;
+                notify( target() );
+                errno = saved;
+            };
+            sigemptyset( &action.sa_mask );
+            sigaction( SIGINT, &action, &previous_int );
+            sigaction( SIGTERM, &action, &previous_term );
+        }
+
+        SignalScope( const SignalScope& ) = delete;
+        SignalScope& operator=( const SignalScope& ) = delete;
+
+        ~SignalScope() {
+            sigaction( SIGINT, &previous_int, nullptr );
+            sigaction( SIGTERM, &previous_term, nullptr );
+            target() = -1;
+        }
+
+    private:
+        static volatile std::sig_atomic_t& target() {
+            static volatile std::sig_atomic_t fd = -1;
+            return fd;
+        }
+
+        struct sigaction previous_int;
+        struct sigaction previous_term;
+    };
+
+    static void notify( int fd ) {
+        char byte = 0;
+        if ( fd >= 0 && write( fd, &byte, 1 ) < 0 ) {
+            // pipe already holds a pending wakeup
+        }
+    }
+
+    struct Client {
+        std::vector< char > input;
+        std::vector< char > output;
+        bool closed = false;
+    };
+
+    struct Request {
+        int fd;
+        uint32_t count;
+        std::vector< double > points;
+        Clock::time_point arrival;
+    };
+
+    void accept_clients() {
+        while ( true ) {
+            int fd = accept4( listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+            if ( fd < 0 )
+                break;
+            clients[ fd ];
+        }
+    }
+
+    /**
+     * drops client that has shut down its writing side once all its requests are answered and sent
+     */
+    void retire_client( int fd ) {
+        auto it = clients.find( fd );
+        if ( it == clients.end() || !it->second.closed || !it->second.output.empty() )
+            return;
+        for ( auto& request : pending )
+            if ( request.fd == fd )
+                return;
+        drop_client( fd );
+    }
+
+    void drop_client( int fd ) {
+        if ( clients.erase( fd ) )
+            close( fd );
+        for ( auto& request : pending )
+            if ( request.fd == fd )
+                request.fd = -1;
+    }
+
+    bool receive( int fd ) {
+        auto it = clients.find( fd );
+        if ( it == clients.end() )
+            return true;
+
+        auto& input = it->second.input;
+        char chunk[ 1 << 16 ];
+        while ( true ) {
+            auto size = read( fd, chunk, sizeof( chunk ) );
+            if ( size == 0 ) {
+                it->second.closed = true;
+                break;
+            }
+            if ( size < 0 ) {
+                if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                    break;
+                if ( errno == EINTR )
+                    continue;
+                return false;
+            }
+            input.insert( input.end(), chunk, chunk + size );
+        }
+
+        size_t offset = 0;
+        while ( input.size() - offset >= sizeof( uint32_t ) ) {
+            uint32_t count;
+            std::memcpy( &count, input.data() + offset, sizeof( count ) );
+            if ( count > config.max_batch )
+                return false;
+            size_t size = sizeof( count ) + size_t( count ) * 3 * sizeof( double );
+            if ( input.size() - offset < size )
+                break;
+
+            Request request{ fd, count, std::vector< double >( size_t( count ) * 3 ), Clock::now() };
+            std::memcpy( request.points.data(), input.data() + offset + sizeof( count ), size - sizeof( count ) );
+            pending.push_back( std::move( request ) );
+            pending_points += count;
+            offset += size;
+        }
+        input.erase( input.begin(), input.begin() + offset );
+        return true;
+    }
+
+    bool send( int fd ) {
+        auto it = clients.find( fd );
+        if ( it == clients.end() )
+            return true;
+
+        auto& output = it->second.output;
+        size_t offset = 0;
+        while ( offset < output.size() ) {
+            // peer may close before reading its reply, MSG_NOSIGNAL turns SIGPIPE into EPIPE and client is dropped
+            auto size = ::send( fd, output.data() + offset, output.size() - offset, MSG_NOSIGNAL );
+            if ( size < 0 ) {
+                if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                    break;
+                if ( errno == EINTR )
+                    continue;
+                return false;
+            }
+            offset += size;
+        }
+        output.erase( output.begin(), output.begin() + offset );
+        return true;
+    }
+
+    /**
+     * takes requests in arrival order up to max_batch points, requests larger than max_batch are rejected on receive
+     */
+    template< typename Kernel >
+    void process( Kernel& kernel, PoolBuffer< double >& batch ) {
+        uint64_t total = 0;
+        size_t taken = 0;
+        while ( taken < pending.size() && total + pending[ taken ].count <= config.max_batch )
+            total += pending[ taken++ ].count;
+        auto count = uint32_t( total );
+
+        uint32_t offset = 0;
+        for ( size_t r = 0; r < taken; r++ ) {
+            auto& points = pending[ r ].points;
+            for ( uint32_t i = 0; i < pending[ r ].count; i++ ) {
+                batch[ offset + i ] = points[ i * 3 ];
+                batch[ offset + i + count ] = points[ i * 3 + 1 ];
+                batch[ offset + i + count * 2 ] = points[ i * 3 + 2 ];
+            }
+            offset += pending[ r ].count;
+        }
+
+        kernel( batch.data(), count );
+
+        offset = 0;
+        for ( size_t r = 0; r < taken; r++ ) {
+            auto& request = pending[ r ];
+            auto client = clients.find( request.fd );
+            if ( client != clients.end() ) {
+                auto& output = client->second.output;
+                auto header = reinterpret_cast< const char* >( &request.count );
+                output.insert( output.end(), header, header + sizeof( request.count ) );
+                auto start = output.size();
+                output.resize( start + size_t( request.count ) * 3 * sizeof( double ) );
+                for ( uint32_t i = 0; i < request.count; i++ ) {
+                    double point[ 3 ] = { batch[ offset + i ], batch[ offset + i + count ], batch[ offset + i + count * 2 ] };
+                    std::memcpy( output.data() + start + size_t( i ) * sizeof( point ), point, sizeof( point ) );
+                }
+            }
+            offset += request.count;
+        }
+
+        std::vector< int > answered;
+        for ( size_t r = 0; r < taken; r++ )
+            answered.push_back( pending[ r ].fd );
+        pending.erase( pending.begin(), pending.begin() + taken );
+        pending_points -= count;
+
+        for ( auto fd : answered ) {
+            if ( clients.count( fd ) && !send( fd ) )
+                drop_client( fd );
+            else
+                retire_client( fd );
+        }
+    }
+
+    ServerConfig config;
+    int listener;
+    int wakeup[ 2 ];
+    std::map< int, Client > clients;
+    std::deque< Request > pending;
+    uint64_t pending_points;
+};
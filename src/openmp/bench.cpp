@@ -0,0 +1,229 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include <buffer_pool.hpp>
+#include <perf_counters.hpp>
+
+#include "georef.hpp"
+
+/**
+ *
+ */
+struct Geod2Ecef {
+    static constexpr const char* name = "geod2ecef";
+
+    template< typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.geod2ecef( object );
+    }
+};
+
+struct Ecef2Geod {
+    static constexpr const char* name = "ecef2geod";
+
+    template< typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.ecef2geod( object );
+    }
+};
+
+struct Ecef2Topo {
+    static constexpr const char* name = "ecef2topo";
+
+    template< typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.ecef2topo( object );
+    }
+};
+
+struct Topo2Ecef {
+    static constexpr const char* name = "topo2ecef";
+
+    template< typename Object >
+    void operator()( Georef& georef, Object& object ) const {
+        georef.topo2ecef( object );
+    }
+};
+
+/**
+ * point-at-a-time transform of interleaved x y z triples
+ */
+struct AosLayout {
+    static constexpr const char* name = "aos";
+
+    template< typename Stage >
+    static void run( Stage stage, Georef& georef, double* data, uint32_t count ) {
+        auto points = reinterpret_cast< Point3< double >* >( data );
+        for ( uint32_t i = 0; i < count; i++ )
+            stage( georef, points[ i ] );
+    }
+
+    static void store( double* data, uint32_t count, uint32_t i, Point3< double > point ) {
+        std::memcpy( data + i * 3, point.storage, sizeof( point.storage ) );
+    }
+};
+
+/**
+ * batched transform of separate x, y and z arrays as in offload kernels
+ */
+struct SoaLayout {
+    static constexpr const char* name = "soa";
+
+    template< typename Stage >
+    static void run( Stage stage, Georef& georef, double* data, uint32_t count ) {
+        for ( uint32_t i = 0; i < count; i++ ) {
+            auto point = Point3< double >::create( data[ i ], data[ i + count ], data[ i + count * 2 ] );
+            stage( georef, point );
+            data[ i ] = point.x();
+            data[ i + count ] = point.y();
+            data[ i + count * 2 ] = point.z();
+        }
+    }
+
+    static void store( double* data, uint32_t count, uint32_t i, Point3< double > point ) {
+        data[ i ] = point.x();
+        data[ i + count ] = point.y();
+        data[ i + count * 2 ] = point.z();
+    }
+};
+
+/**
+ *
+ */
+struct Bench {
+    Georef georef;
+    PerfCounters counters;
+    PoolBuffer< double > input;
+    PoolBuffer< double > work;
+    PoolBuffer< char > scratch;
+    uint32_t repeats;
+
+    /**
+     * fills input with points valid for stage, i.e. geodetic grid projected up to stage input
+     */
+    template< typename Layout, typename Stage >
+    void prepare( Stage, uint32_t count ) {
+        for ( uint32_t i = 0; i < count; i++ ) {
+            auto point = Point3< double >::create(
+                    -180 + 360 * double( i ) / std::max( count - 1, 1u ),
+                    -89 + 178 * double( ( i * 7919u ) % count ) / std::max( count - 1, 1u ),
+                    100 * double( i % 16 ) );
+            if ( !std::is_same< Stage, Geod2Ecef >::value )
+                georef.geod2ecef( point );
+            if ( std::is_same< Stage, Topo2Ecef >::value )
+                georef.ecef2topo( point );
+            Layout::store( input.data(), count, i, point );
+        }
+    }
+
+    void flush() {
+        for ( std::size_t i = 0; i < scratch.size(); i += cache_line_size )
+            scratch[ i ]++;
+    }
+
+    template< typename Layout, typename Stage >
+    void measure( Stage stage, uint32_t count, bool cold ) {
+        prepare< Layout >( stage, count );
+
+        double seconds = 0;
+        PerfSample total = {};
+        for ( uint32_t r = 0; r < repeats; r++ ) {
+            if ( !cold ) {
+                std::memcpy( work.data(), input.data(), sizeof( double ) * count * 3 );
+                Layout::run( stage, georef, work.data(), count );
+            }
+
+            std::memcpy( work.data(), input.data(), sizeof( double ) * count * 3 );
+            if ( cold )
+                flush();
+
+            counters.start();
+            auto timer = std::chrono::steady_clock::now();
+            Layout::run( stage, georef, work.data(), count );
+            seconds += std::chrono::duration_cast< std::chrono::duration< double > >(
+                    std::chrono::steady_clock::now() - timer ).count();
+            auto sample = counters.stop();
+
+            total.cycles += sample.cycles;
+            total.instructions += sample.instructions;
+            total.cache_misses += sample.cache_misses;
+            total.branch_misses += sample.branch_misses;
+        }
+
+        double points = double( count ) * repeats;
+        std::cout << std::setw( 10 ) << Stage::name
+                << std::setw( 5 ) << Layout::name
+                << std::setw( 6 ) << ( cold ? "cold" : "hot" )
+                << std::setw( 10 ) << count
+                << std::setw( 10 ) << seconds * 1e9 / points;
+        if ( counters.available() ) {
+            std::cout << std::setw( 10 ) << total.cycles / points
+                    << std::setw( 8 ) << total.ipc()
+                    << std::setw( 10 ) << total.cache_misses / points
+                    << std::setw( 10 ) << total.branch_misses / points;
+        }
+        std::cout << "\n";
+    }
+
+    template< typename Stage >
+    void measure( Stage stage, const std::vector< uint32_t >& sizes ) {
+        for ( auto count : sizes ) {
+            for ( bool cold : { false, true } ) {
+                measure< AosLayout >( stage, count, cold );
+                measure< SoaLayout >( stage, count, cold );
+            }
+        }
+    }
+};
+
+/**
+ * usage: offload_openmp_bench [repeats] [batch sizes...]
+ */
+int main( int argc, char** argv ) {
+    auto config = Config::create();
+
+    std::vector< uint32_t > sizes;
+    for ( int i = 2; i < argc; i++ )
+        sizes.push_back( std::strtoul( argv[ i ], nullptr, 10 ) );
+    if ( sizes.empty() )
+        sizes = { 1'000, 100'000, 10'000'000 };
+
+    auto max_count = *std::max_element( sizes.begin(), sizes.end() );
+    auto& pool = BufferPool::global();
+
+    Bench bench;
+    bench.georef = Georef::create( config );
+    bench.input = pool.acquire< double >( max_count * 3 );
+    bench.work = pool.acquire< double >( max_count * 3 );
+    bench.scratch = pool.acquire< char >( 256 << 20 );
+    bench.repeats = argc > 1 ? std::max( std::atoi( argv[ 1 ] ), 1 ) : 5;
+    std::memset( bench.scratch.data(), 0, bench.scratch.size() );
+
+    std::cout << std::fixed << std::setprecision( 3 );
+    std::cout << std::setw( 10 ) << "function"
+            << std::setw( 5 ) << "mem"
+            << std::setw( 6 ) << "cache"
+            << std::setw( 10 ) << "points"
+            << std::setw( 10 ) << "ns/pt";
+    if ( bench.counters.available() ) {
+        std::cout << std::setw( 10 ) << "cyc/pt"
+                << std::setw( 8 ) << "ipc"
+                << std::setw( 10 ) << "llcm/pt"
+                << std::setw( 10 ) << "brm/pt";
+    } else {
+        std::cout << "  (hardware counters unavailable, check kernel.perf_event_paranoid)";
+    }
+    std::cout << "\n";
+
+    bench.measure( Geod2Ecef{}, sizes );
+    bench.measure( Ecef2Geod{}, sizes );
+    bench.measure( Ecef2Topo{}, sizes );
+    bench.measure( Topo2Ecef{}, sizes );
+
+    return 0;
+}
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+
+#if _OPENMP
+#include <omp.h>
+#else
+// ---
+inline void omp_set_num_threads( int ) {}
+inline int omp_get_num_threads() { return 1; }
+inline int omp_get_max_threads() { return 1; }
+inline int omp_get_thread_num() { return 0; }
+inline int omp_get_num_procs() { return 1; }
+// ---
+inline void omp_set_default_device( int ) {}
+inline int omp_get_default_device() { return 0; }
+inline int omp_get_num_devices() { return 0; }
+inline int omp_get_num_teams() { return 1; }
+inline int omp_get_team_num() { return 0; }
+// ---
+inline int omp_is_initial_device() { return 0; }
+inline int omp_get_initial_device() { return 0; }
+inline int omp_get_max_task_priority() { return 0; }
+#endif
+
+// helmert transformation and pipelines are shared with sycl backend and called in target regions
+#pragma omp declare target
+#include <helmert.hpp>
+#include <pipelines.hpp>
+#pragma omp end declare target
+
+#pragma omp declare target
+
+constexpr double radian = M_PI / 180.;
+constexpr double degree = 1 / radian;
+
+template< int O >
+using Orientation = std::integral_constant< int, O >;
+using Ox = Orientation< 0 >;
+using Oy = Orientation< 1 >;
+using Oz = Orientation< 2 >;
+
+template< typename Real >
+inline auto eval( Real val ) {
+    return val;
+}
+
+template< typename Real >
+inline auto select( bool if_cond, Real then_val, Real else_val ) {
+    return if_cond ? then_val : else_val;
+}
+
+#pragma omp end declare target
+
+/**
+ *
+ */
+struct Config {
+    double origin_logitude;
+    double origin_latitude;
+    double origin_altitude;
+    double scale_factor;
+
+    static Config create() {
+        Config config;
+        config.origin_logitude = 0;
+        config.origin_latitude = 0;
+        config.origin_altitude = 0;
+        config.scale_factor = 0.75;
+        return config;
+    }
+};
+
+#pragma omp declare target
+
+/**
+ *
+ */
+template< typename Scalar >
+struct Point3 {
+    Scalar storage[ 3 ];
+
+    static Point3< Scalar > create( Scalar x, Scalar y, Scalar z ) {
+        Point3< Scalar > point;
+        point.storage[ 0 ] = x;
+        point.storage[ 1 ] = y;
+        point.storage[ 2 ] = z;
+        return point;
+    }
+
+    auto& x() {
+        return storage[ 0 ];
+    }
+
+    auto& y() {
+        return storage[ 1 ];
+    }
+
+    auto& z() {
+        return storage[ 2 ];
+    }
+
+    template< int O >
+    auto& get( Orientation< O > o ) {
+        return storage[ o ];
+    }
+
+    template< int O1, int O2 >
+    void swap( Orientation< O1 > o1, Orientation< O2 > o2 ) {
+        std::swap( get( o1 ), get( o2 ) );
+    }
+
+    template< int O1, int O2, typename Real >
+    void rotate( Orientation< O1 > o1, Orientation< O2 > o2, Real cos, Real sin ) {
+        auto v1 = get( o1 );
+        auto v2 = get( o2 );
+        get( o1 ) = cos * v1 + sin * v2;
+        get( o2 ) = -sin * v1 + cos * v2;
+    }
+};
+
+/**
+ * tiled geoid undulation grid, see geoid_grid.hpp for layout
+ */
+struct Geoid {
+    const float* nodes;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t tile_size;
+    uint32_t tile_cols;
+    double lon0;
+    double lat0;
+    double step;
+    double period;
+
+    float node( uint32_t row, uint32_t col ) const {
+        auto tile = size_t( row / tile_size ) * tile_cols + col / tile_size;
+        return nodes[ ( tile * tile_size + row % tile_size ) * tile_size + col % tile_size ];
+    }
+
+    /**
+     * bilinear interpolation in degrees, longitude of global grid wraps around every period = 360 / step nodes,
+     * so grids repeating 0 / 360 column are read from their first period, regional grid narrower than period
+     * is wrapped around its middle and clamped like latitude
+     */
+    double undulation( double longitude, double latitude ) const {
+        auto global = cols + 1e-6 >= period;
+        auto u = ( longitude - lon0 ) / step;
+        auto v = ( latitude - lat0 ) / step;
+        auto start = select( global, 0., ( cols - 1 ) / 2. - period / 2 );
+        u -= floor( ( u - start ) / period ) * period;
+        u = select( global, u, select( u < 0, 0., select( u > cols - 1, double( cols - 1 ), u ) ) );
+        v = select( v < 0, 0., select( v > rows - 1, double( rows - 1 ), v ) );
+        auto col = uint32_t( u );
+        auto row = uint32_t( v );
+        auto du = u - col;
+        auto dv = v - row;
+        col = select( col >= cols, select( global, 0u, cols - 1 ), col );
+        auto next_col = select( col + 1 >= cols, select( global, 0u, col ), col + 1 );
+        auto next_row = select( row + 1 >= rows, row, row + 1 );
+        auto south = node( row, col ) * ( 1 - du ) + node( row, next_col ) * du;
+        auto north = node( next_row, col ) * ( 1 - du ) + node( next_row, next_col ) * du;
+        return south * ( 1 - dv ) + north * dv;
+    }
+};
+
+/**
+ *
+ */
+struct Georef {
+    Point3< double > origin;
+    double sin_lon0;
+    double cos_lon0;
+    double sin_lat0;
+    double cos_lat0;
+    double scale_factor;
+    double major_radius;
+    double minor_radius;
+    double polar_radius;
+    double normal_radius;
+    double flattening;
+    double eccentricity1;
+    double eccentricity2;
+
+    static Georef create( Config& config ) {
+        double longitude = config.origin_logitude * radian;
+        double latitude = config.origin_latitude * radian;
+        double altitude = config.origin_altitude;
+        double flattening = 1. / 298.257223563;
+        double major_radius = 6378137. / config.scale_factor;
+        double minor_radius = major_radius * ( 1. - flattening );
+        double polar_radius = major_radius / ( 1. - flattening );
+        double eccentricity1 = flattening * ( 2. - flattening );
+        double eccentricity2 = eccentricity1 / ( 1. - eccentricity1 );
+        double sin_lon0 = std::sin( longitude );
+        double cos_lon0 = std::cos( longitude );
+        double sin_lat0 = std::sin( latitude );
+        double cos_lat0 = std::cos( latitude );
+        double normal_radius = polar_radius / std::sqrt( 1. + eccentricity2 * cos_lat0 * cos_lat0 );
+
+        Georef georef;
+        georef.origin = Point3< double >::create( longitude, latitude, altitude );
+        georef.sin_lon0 = sin_lon0;
+        georef.cos_lon0 = cos_lon0;
+        georef.sin_lat0 = sin_lat0;
+        georef.cos_lat0 = cos_lat0;
+        georef.scale_factor = config.scale_factor;
+        georef.major_radius = major_radius;
+        georef.minor_radius = minor_radius;
+        georef.polar_radius = polar_radius;
+        georef.normal_radius = normal_radius;
+        georef.flattening = flattening;
+        georef.eccentricity1 = eccentricity1;
+        georef.eccentricity2 = eccentricity2;
+        return georef;
+    }
+
+    /**
+     * projection epsg:4326 to epsg:4978
+     */
+    template< typename Object >
+    Georef& geod2ecef( Object& object ) {
+        auto longitude = eval( ( origin.x() + ( object.x() - origin.x() ) * scale_factor ) * radian );
+        auto latitude = eval( ( origin.y() + ( object.y() - origin.y() ) * scale_factor ) * radian );
+        auto cos_lat = eval( cos( latitude ) );
+        auto sin_lat = sin( latitude );
+        auto normal = eval( polar_radius / sqrt( 1. + eccentricity2 * cos_lat * cos_lat ) );
+        auto hplane = eval( ( normal + object.z() ) * cos_lat );
+        object.x() = hplane * cos( longitude );
+        object.y() = hplane * sin( longitude );
+        object.z() = ( object.z() + normal * ( 1 - eccentricity1 ) ) * sin_lat;
+        return *this;
+    }
+
+    /**
+     * projection epsg:4978 to epsg:4326
+     */
+    template< typename Object >
+    Georef& ecef2geod( Object& object ) {
+        auto hplane = eval( hypot( object.x(), object.y() ) );
+        auto tangent0 = object.z() / hplane * ( 1. + ( eccentricity2 * minor_radius ) / hypot( hplane, object.z() ) );
+        auto latitude0 = eval( atan( tangent0 * ( 1. - flattening ) ) );
+        auto tangent1 = ( ( object.z() + ( eccentricity2 * minor_radius ) * pow( sin( latitude0 ), 3 ) ) /
+                ( hplane - ( eccentricity1 * major_radius ) * pow( cos( latitude0 ), 3 ) ) );
+        auto latitude1 = eval( atan( tangent1 * ( 1. - flattening ) ) );
+        auto tangent = eval( ( object.z() + ( eccentricity2 * minor_radius ) * pow( sin( latitude1 ), 3 ) ) /
+                ( hplane - ( eccentricity1 * major_radius ) * pow( cos( latitude1 ), 3 ) ) );
+        auto longitude = atan2( object.y(), object.x() );
+        auto latitude = eval( atan( tangent ) );
+        auto cos_lat = eval( select( latitude == M_PI_2, 1., cos( latitude ) ) );
+        auto sin_lat = select( latitude == 0, 1., sin( latitude ) );
+        auto normal = polar_radius / sqrt( 1. + eccentricity2 * cos_lat * cos_lat );
+        object.x() = origin.x() + ( longitude * degree - origin.x() ) / scale_factor;
+        object.y() = origin.y() + ( latitude * degree - origin.y() ) / scale_factor;
+        object.z() = select( abs( tangent ) <= 1, hplane / cos_lat - normal, object.z() / sin_lat - normal * ( 1. - eccentricity1 ) );
+        return *this;
+    }
+
+    /**
+     * projection epsg:4326 with orthometric height to epsg:4978
+     */
+    template< typename Object >
+    Georef& geod2ecef( Object& object, const Geoid& geoid ) {
+        object.z() += geoid.undulation(
+                origin.x() + ( object.x() - origin.x() ) * scale_factor,
+                origin.y() + ( object.y() - origin.y() ) * scale_factor );
+        return geod2ecef( object );
+    }
+
+    /**
+     * projection epsg:4978 to epsg:4326 with orthometric height
+     */
+    template< typename Object >
+    Georef& ecef2geod( Object& object, const Geoid& geoid ) {
+        ecef2geod( object );
+        object.z() -= geoid.undulation(
+                origin.x() + ( object.x() - origin.x() ) * scale_factor,
+                origin.y() + ( object.y() - origin.y() ) * scale_factor );
+        return *this;
+    }
+
+    /**
+     * datum shift in epsg:4978 at reference epoch of helmert
+     */
+    template< typename Object >
+    Georef& ecef2ecef( Object& object, const Helmert& helmert ) {
+        helmert.apply( object );
+        return *this;
+    }
+
+    /**
+     * datum shift in epsg:4978 at epoch of point
+     */
+    template< typename Object >
+    Georef& ecef2ecef( Object& object, const Helmert& helmert, double epoch ) {
+        helmert.apply( object, epoch );
+        return *this;
+    }
+
+    /**
+     * projection epsg:4978 to epsg:5819
+     */
+    template< typename Object >
+    Georef& ecef2topo( Object& object ) {
+        object.z() += eccentricity1 * normal_radius * sin_lat0;
+        object.rotate( Ox{}, Oy{}, cos_lon0, sin_lon0 );
+        object.rotate( Oz{}, Ox{}, sin_lat0, cos_lat0 );
+        object.swap( Ox{}, Oy{} );
+        object.y() = -object.y();
+        object.z() -= normal_radius + origin.z();
+        return *this;
+    }
+
+    /**
+     * projection epsg:5819 to epsg:4978
+     */
+    template< typename Object >
+    Georef& topo2ecef( Object& object ) {
+        object.z() += normal_radius + origin.z();
+        object.y() = -object.y();
+        object.swap( Ox{}, Oy{} );
+        object.rotate( Oz{}, Ox{}, sin_lat0, -cos_lat0 );
+        object.rotate( Ox{}, Oy{}, cos_lon0, -sin_lon0 );
+        object.z() -= eccentricity1 * normal_radius * sin_lat0;
+        return *this;
+    }
+};
+
+/**
+ * points stored as x[count] y[count] z[count]
+ */
+struct PointView {
+    double* data;
+    uint32_t count;
+};
+
+/**
+ * calls pipeline( georef, point, i ) for pipelines reading per point arrays, pipeline( georef, point ) otherwise
+ */
+template< typename Pipeline, typename Object >
+inline void apply_pipeline( const Pipeline& pipeline, Georef& georef, Object& object, uint32_t i ) {
+    if constexpr ( std::is_invocable_v< const Pipeline&, Georef&, Object&, uint32_t > )
+        pipeline( georef, object, i );
+    else
+        pipeline( georef, object );
+}
+
+/**
+ * applies pipeline to point i of source and stores it to result, both stored as x[count] y[count] z[count]
+ */
+template< typename Pipeline >
+inline Point3< double > transform_point( const Pipeline& pipeline, Georef& georef, const double* source, double* result,
+        uint32_t count, uint32_t i ) {
+    uint32_t xi = i;
+    uint32_t yi = i + count;
+    uint32_t zi = i + count * 2;
+    auto point = Point3< double >::create( source[ xi ], source[ yi ], source[ zi ] );
+    apply_pipeline( pipeline, georef, point, i );
+    result[ xi ] = point.x();
+    result[ yi ] = point.y();
+    result[ zi ] = point.z();
+    return point;
+}
+
+#pragma omp end declare target
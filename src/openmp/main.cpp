@@ -1,243 +1,81 @@
 #include <iostream>
 #include <iomanip>
-#include <type_traits>
 #include <vector>
 #include <chrono>
 #include <cmath>
+#include <string>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
 
-#if _OPENMP
-#include <omp.h>
-#else
-// ---
-void omp_set_num_threads( int ) {}
-int omp_get_num_threads() { return 1; }
-int omp_get_max_threads() { return 1; }
-int omp_get_thread_num() { return 0; }
-int omp_get_num_procs() { return 1; }
-// ---
-void omp_set_default_device( int ) {}
-int omp_get_default_device() { return 0; }
-int omp_get_num_devices() { return 0; }
-int omp_get_num_teams() { return 1; }
-int omp_get_team_num() { return 0; }
-// ---
-int omp_is_initial_device() { return 0; }
-int omp_get_initial_device() { return 0; }
-int omp_get_max_task_priority() { return 0; }
-#endif
-
-#pragma omp declare target
-
-constexpr double radian = M_PI / 180.;
-constexpr double degree = 1 / radian;
-
-template< int O >
-using Orientation = std::integral_constant< int, O >;
-using Ox = Orientation< 0 >;
-using Oy = Orientation< 1 >;
-using Oz = Orientation< 2 >;
-
-template< typename Real >
-inline auto eval( Real val ) {
-    return val;
-}
-
-template< typename Real >
-inline auto select( bool if_cond, Real then_val, Real else_val ) {
-    return if_cond ? then_val : else_val;
-}
+#include <buffer_pool.hpp>
+#include <geoid_grid.hpp>
+#include <spatial_index.hpp>
+#include <text_export.hpp>
+#include <transform_server.hpp>
 
-#pragma omp end declare target
+#include "georef.hpp"
+#include "transform.hpp"
 
 /**
- *
+ * round trip of view through async transform with both directions fused in one kernel,
+ * bounds of result are reduced in the same kernel and should match input
  */
-struct Config {
-    double origin_logitude;
-    double origin_latitude;
-    double origin_altitude;
-    double scale_factor;
-
-    static Config create() {
-        Config config;
-        config.origin_logitude = 0;
-        config.origin_latitude = 0;
-        config.origin_altitude = 0;
-        config.scale_factor = 0.75;
-        return config;
-    }
-};
+template< typename Pipeline >
+Task process( Georef georef, PointView view, Pipeline round_trip, bool offload ) {
+    auto timer = std::chrono::steady_clock::now();
+
+    Statistics statistics;
+    co_await transform_async( georef, view, round_trip, statistics, offload );
 
-#pragma omp declare target
+    std::cout << std::chrono::duration_cast< std::chrono::duration< double > >(
+            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+    std::cout << "  bounds: " << statistics.min[ 0 ] << " " << statistics.min[ 1 ] << " " << statistics.min[ 2 ]
+            << " - " << statistics.max[ 0 ] << " " << statistics.max[ 1 ] << " " << statistics.max[ 2 ] << "\n";
+}
 
 /**
- *
+ * projects geodetic points to topocentric with georef and server batch buffer kept mapped on device
  */
-template< typename Scalar >
-struct Point3 {
-    Scalar storage[ 3 ];
-
-    static Point3< Scalar > create( Scalar x, Scalar y, Scalar z ) {
-        Point3< Scalar > point;
-        point.storage[ 0 ] = x;
-        point.storage[ 1 ] = y;
-        point.storage[ 2 ] = z;
-        return point;
-    }
+template< typename Pipeline >
+void serve( Georef& georef, const Dispatcher& dispatcher, const ServerConfig& config,
+        Pipeline host_pipeline, Pipeline device_pipeline ) {
+    double* mapped = nullptr;
+    size_t capacity = size_t( config.max_batch ) * 3;
 
-    auto& x() {
-        return storage[ 0 ];
-    }
-
-    auto& y() {
-        return storage[ 1 ];
-    }
+    #pragma omp target enter data map(to: georef)
 
-    auto& z() {
-        return storage[ 2 ];
-    }
+    TransformServer server( config );
+    std::cout << "serving on " << config.socket_path << "\n" << std::flush;
 
-    template< int O >
-    auto& get( Orientation< O > o ) {
-        return storage[ o ];
-    }
+    server.run( [&]( double* batch, uint32_t count ) {
+        if ( !dispatcher.offload( count ) ) {
+            transform( georef, PointView{ batch, count }, host_pipeline, false );
+            return;
+        }
 
-    template< int O1, int O2 >
-    void swap( Orientation< O1 > o1, Orientation< O2 > o2 ) {
-        std::swap( get( o1 ), get( o2 ) );
-    }
+        // server batch buffer lives for the whole run, it is mapped once on first offloaded batch
+        if ( batch != mapped ) {
+            if ( mapped ) {
+                #pragma omp target exit data map(delete: mapped[:capacity])
+            }
+            mapped = batch;
+            #pragma omp target enter data map(alloc: batch[:capacity])
+        }
 
-    template< int O1, int O2, typename Real >
-    void rotate( Orientation< O1 > o1, Orientation< O2 > o2, Real cos, Real sin ) {
-        auto v1 = get( o1 );
-        auto v2 = get( o2 );
-        get( o1 ) = cos * v1 + sin * v2;
-        get( o2 ) = -sin * v1 + cos * v2;
-    }
-};
+        auto size = size_t( count ) * 3;
+        #pragma omp target update to(batch[:size])
 
-/**
- *
- */
-struct Georef {
-    Point3< double > origin;
-    double sin_lon0;
-    double cos_lon0;
-    double sin_lat0;
-    double cos_lat0;
-    double scale_factor;
-    double major_radius;
-    double minor_radius;
-    double polar_radius;
-    double normal_radius;
-    double flattening;
-    double eccentricity1;
-    double eccentricity2;
-
-    static Georef create( Config& config ) {
-        double longitude = config.origin_logitude * radian;
-        double latitude = config.origin_latitude * radian;
-        double altitude = config.origin_altitude;
-        double flattening = 1. / 298.257223563;
-        double major_radius = 6378137. / config.scale_factor;
-        double minor_radius = major_radius * ( 1. - flattening );
-        double polar_radius = major_radius / ( 1. - flattening );
-        double eccentricity1 = flattening * ( 2. - flattening );
-        double eccentricity2 = eccentricity1 / ( 1. - eccentricity1 );
-        double sin_lon0 = std::sin( longitude );
-        double cos_lon0 = std::cos( longitude );
-        double sin_lat0 = std::sin( latitude );
-        double cos_lat0 = std::cos( latitude );
-        double normal_radius = polar_radius / std::sqrt( 1. + eccentricity2 * cos_lat0 * cos_lat0 );
-
-        Georef georef;
-        georef.origin = Point3< double >::create( longitude, latitude, altitude );
-        georef.sin_lon0 = sin_lon0;
-        georef.cos_lon0 = cos_lon0;
-        georef.sin_lat0 = sin_lat0;
-        georef.cos_lat0 = cos_lat0;
-        georef.scale_factor = config.scale_factor;
-        georef.major_radius = major_radius;
-        georef.minor_radius = minor_radius;
-        georef.polar_radius = polar_radius;
-        georef.normal_radius = normal_radius;
-        georef.flattening = flattening;
-        georef.eccentricity1 = eccentricity1;
-        georef.eccentricity2 = eccentricity2;
-        return georef;
-    }
+        transform_kernel( georef, batch, batch, count, device_pipeline, nullptr, true );
 
-    /**
-     * projection epsg:4326 to epsg:4978
-     */
-    template< typename Object >
-    Georef& geod2ecef( Object& object ) {
-        auto longitude = eval( ( origin.x() + ( object.x() - origin.x() ) * scale_factor ) * radian );
-        auto latitude = eval( ( origin.y() + ( object.y() - origin.y() ) * scale_factor ) * radian );
-        auto cos_lat = eval( cos( latitude ) );
-        auto sin_lat = sin( latitude );
-        auto normal = eval( polar_radius / sqrt( 1. + eccentricity2 * cos_lat * cos_lat ) );
-        auto hplane = eval( ( normal + object.z() ) * cos_lat );
-        object.x() = hplane * cos( longitude );
-        object.y() = hplane * sin( longitude );
-        object.z() = ( object.z() + normal * ( 1 - eccentricity1 ) ) * sin_lat;
-        return *this;
-    }
+        #pragma omp target update from(batch[:size])
+    } );
 
-    /**
-     * projection epsg:4978 to epsg:4326
-     */
-    template< typename Object >
-    Georef& ecef2geod( Object& object ) {
-        auto hplane = eval( hypot( object.x(), object.y() ) );
-        auto tangent0 = object.z() / hplane * ( 1. + ( eccentricity2 * minor_radius ) / hypot( hplane, object.z() ) );
-        auto latitude0 = eval( atan( tangent0 * ( 1. - flattening ) ) );
-        auto tangent1 = ( ( object.z() + ( eccentricity2 * minor_radius ) * pow( sin( latitude0 ), 3 ) ) /
-                ( hplane - ( eccentricity1 * major_radius ) * pow( cos( latitude0 ), 3 ) ) );
-        auto latitude1 = eval( atan( tangent1 * ( 1. - flattening ) ) );
-        auto tangent = eval( ( object.z() + ( eccentricity2 * minor_radius ) * pow( sin( latitude1 ), 3 ) ) /
-                ( hplane - ( eccentricity1 * major_radius ) * pow( cos( latitude1 ), 3 ) ) );
-        auto longitude = atan2( object.y(), object.x() );
-        auto latitude = eval( atan( tangent ) );
-        auto cos_lat = eval( select( latitude == M_PI_2, 1., cos( latitude ) ) );
-        auto sin_lat = select( latitude == 0, 1., sin( latitude ) );
-        auto normal = polar_radius / sqrt( 1. + eccentricity2 * cos_lat * cos_lat );
-        object.x() = origin.x() + ( longitude * degree - origin.x() ) / scale_factor;
-        object.y() = origin.y() + ( latitude * degree - origin.y() ) / scale_factor;
-        object.z() = select( abs( tangent ) <= 1, hplane / cos_lat - normal, object.z() / sin_lat - normal * ( 1. - eccentricity1 ) );
-        return *this;
+    if ( mapped ) {
+        #pragma omp target exit data map(delete: mapped[:capacity])
     }
-
-    /**
-     * projection epsg:4978 to epsg:5819
-     */
-    template< typename Object >
-    Georef& ecef2topo( Object& object ) {
-        object.z() += eccentricity1 * normal_radius * sin_lat0;
-        object.rotate( Ox{}, Oy{}, cos_lon0, sin_lon0 );
-        object.rotate( Oz{}, Ox{}, sin_lat0, cos_lat0 );
-        object.swap( Ox{}, Oy{} );
-        object.y() = -object.y();
-        object.z() -= normal_radius + origin.z();
-        return *this;
-    }
-
-    /**
-     * projection epsg:5819 to epsg:4978
-     */
-    template< typename Object >
-    Georef& topo2ecef( Object& object ) {
-        object.z() += normal_radius + origin.z();
-        object.y() = -object.y();
-        object.swap( Ox{}, Oy{} );
-        object.rotate( Oz{}, Ox{}, sin_lat0, -cos_lat0 );
-        object.rotate( Ox{}, Oy{}, cos_lon0, -sin_lon0 );
-        object.z() -= eccentricity1 * normal_radius * sin_lat0;
-        return *this;
-    }
-};
-
-#pragma omp end declare target
+    #pragma omp target exit data map(delete: georef)
+}
 
 /**
  *
@@ -265,8 +103,53 @@ int main( int argc, char** argv ) {
         std::cout << "threads count: " << num_threads << "\n";
     }
 
+    auto dispatcher = Dispatcher::create( georef );
+    std::cout << "host cost: " << dispatcher.host.overhead * 1e6 << "us + " << dispatcher.host.per_point * 1e9 << "ns/pt\n";
+    std::cout << "device cost: " << dispatcher.device.overhead * 1e6 << "us + " << dispatcher.device.per_point * 1e9 << "ns/pt\n";
+    std::cout << "offload threshold: " << dispatcher.threshold << "\n";
+
+    std::unique_ptr< GeoidGrid > geoid_grid;
+    std::unique_ptr< DeviceGeoid > geoid;
+    std::string export_path;
+    auto export_config = ExportConfig::create();
+    while ( argc > 2 ) {
+        auto option = std::string( argv[ 1 ] );
+        if ( option == "--geoid" ) {
+            geoid_grid = std::make_unique< GeoidGrid >( argv[ 2 ] );
+            geoid = std::make_unique< DeviceGeoid >( *geoid_grid );
+            std::cout << "geoid: " << argv[ 2 ] << "\n";
+        } else if ( option == "--export" ) {
+            export_path = argv[ 2 ];
+        } else if ( option == "--precision" ) {
+            export_config.precision = std::atoi( argv[ 2 ] );
+            if ( export_config.precision < 0 || export_config.precision > ExportConfig::max_precision ) {
+                std::cerr << "--precision must be in 0.." << ExportConfig::max_precision << "\n";
+                return 1;
+            }
+        } else {
+            break;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
+    if ( argc > 1 && std::string( argv[ 1 ] ) == "--serve" ) {
+        auto server_config = ServerConfig::create();
+        if ( argc > 2 )
+            server_config.socket_path = argv[ 2 ];
+        if ( argc > 3 )
+            server_config.deadline = std::chrono::microseconds( std::atol( argv[ 3 ] ) );
+        if ( argc > 4 )
+            server_config.max_batch = std::atol( argv[ 4 ] );
+        if ( geoid )
+            serve( georef, dispatcher, server_config, OrthoGeod2Topo{ geoid->view( false ) }, OrthoGeod2Topo{ geoid->view( true ) } );
+        else
+            serve( georef, dispatcher, server_config, Geod2Topo{}, Geod2Topo{} );
+        return 0;
+    }
+
     uint32_t count = 1'000'000;
-    std::vector< double > storage( count * 3 );
+    auto storage = BufferPool::global().acquire< double >( count * 3 );
 
     {
         for ( uint32_t i = 0; i < count; i++ )
@@ -275,30 +158,118 @@ int main( int argc, char** argv ) {
         for ( uint32_t i = 0; i < count; i++ )
             storage[ i + count ] = -90 + 180 * double( i ) / ( count - 1 );
 
+        for ( uint32_t i = 0; i < count; i++ )
+            storage[ i + count * 2 ] = 0;
+
         std::cout << "in:\n";
         for ( uint32_t i = 0; i < count; i += ( count - 1 ) / 2 )
             std::cout << storage[ i ] << " " << storage[ i + count ] << " " << storage[ i + count * 2 ] << "\n";
     }
 
     {
-        auto data = storage.data();
-        auto size = storage.size();
-        auto timer = std::chrono::steady_clock::now();
+        Executor executor;
+        auto view = PointView{ storage.data(), count };
+        auto offload = dispatcher.offload( count );
+        if ( geoid )
+            executor.spawn( process( georef, view, OrthoRoundTrip{ geoid->view( offload ) }, offload ) );
+        else
+            executor.spawn( process( georef, view, RoundTrip{}, offload ) );
+        executor.run();
+    }
+
+    {
+        auto result = BufferPool::global().acquire< double >( count * 3 );
+        DeviceContext context( PointView{ storage.data(), count }, PointView{ result.data(), count } );
+
+        for ( double longitude : { -90., 0., 90. } ) {
+            auto origin_config = config;
+            origin_config.origin_logitude = longitude;
+            auto timer = std::chrono::steady_clock::now();
+
+            Statistics statistics;
+            context.transform( Georef::create( origin_config ), Geod2Topo{}, statistics );
+            context.download( 0, 1 );
+
+            std::cout << "origin " << longitude << ": " << result[ 0 ] << " " << result[ count ] << " " << result[ count * 2 ] << " "
+                    << std::chrono::duration_cast< std::chrono::duration< double > >(
+                            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+            std::cout << "  bounds: " << statistics.min[ 0 ] << " " << statistics.min[ 1 ] << " " << statistics.min[ 2 ]
+                    << " - " << statistics.max[ 0 ] << " " << statistics.max[ 1 ] << " " << statistics.max[ 2 ] << "\n";
+            std::cout << "  centroid: " << statistics.centroid( 0 ) << " " << statistics.centroid( 1 ) << " " << statistics.centroid( 2 ) << "\n";
+        }
 
-        #pragma omp target map(tofrom: data[:size]), map(to: georef)
-        #pragma omp teams distribute parallel for firstprivate(georef)
-        for ( uint32_t i = 0; i < count; i++ ) {
-            uint32_t xi = i;
-            uint32_t yi = i + count;
-            uint32_t zi = i + count * 2;
-            auto point = Point3< double >::create( data[ xi ], data[ yi ], data[ zi ] );
-            georef.geod2ecef( point ).ecef2topo( point ).topo2ecef( point ).ecef2geod( point );
-            data[ xi ] = point.x();
-            data[ yi ] = point.y();
-            data[ zi ] = point.z();
+        {
+            context.download();
+            auto timer = std::chrono::steady_clock::now();
+            auto index = SpatialIndex::build( result.data(), count, 10'000 );
+            std::cout << "index: " << index.cell_count() << " cells " << std::chrono::duration_cast< std::chrono::duration< double > >(
+                    std::chrono::steady_clock::now() - timer ).count() << "s\n";
+
+            // last origin longitude is 90, query around a point of the cloud rather than around origin
+            double center[ 3 ] = { result[ count / 4 ], result[ count / 4 + count ], result[ count / 4 + count * 2 ] };
+            timer = std::chrono::steady_clock::now();
+            auto inside = index.radius( center, 1'000'000 );
+            auto nearest = index.nearest( center, 10 );
+            std::cout << "  within 1000km: " << inside.size() << ", nearest: " << result[ nearest[ 0 ] ] << " "
+                    << result[ nearest[ 0 ] + count ] << " " << result[ nearest[ 0 ] + count * 2 ] << " "
+                    << std::chrono::duration_cast< std::chrono::duration< double > >(
+                            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+
+            std::cout << "  brute force mismatches: " << check_spatial_index( result.data(), count ) << "\n";
         }
 
-        std::cout << std::chrono::duration_cast< std::chrono::duration< double > >(
+        {
+            // itrf2014 to itrf2008
+            auto helmert_config = HelmertConfig::create();
+            helmert_config.tx = 0.0016;
+            helmert_config.ty = 0.0019;
+            helmert_config.tz = 0.0024;
+            helmert_config.scale = -0.02;
+            helmert_config.rate_tz = -0.0001;
+            helmert_config.rate_scale = 0.03;
+            helmert_config.reference_epoch = 2010;
+
+            auto epochs = BufferPool::global().acquire< double >( count );
+            for ( uint32_t i = 0; i < count; i++ )
+                epochs[ i ] = 2000 + 25 * double( i ) / ( count - 1 );
+            DeviceEpochs device_epochs( epochs.data(), count );
+
+            Statistics plain, shifted;
+            auto timer = std::chrono::steady_clock::now();
+            context.transform( georef, Geod2Topo{}, plain );
+            context.transform( georef, HelmertGeod2Topo{ Helmert::create( helmert_config, georef.scale_factor ), device_epochs.view( true ) }, shifted );
+            std::cout << "helmert shift: " << shifted.centroid( 0 ) - plain.centroid( 0 ) << " "
+                    << shifted.centroid( 1 ) - plain.centroid( 1 ) << " " << shifted.centroid( 2 ) - plain.centroid( 2 ) << " "
+                    << std::chrono::duration_cast< std::chrono::duration< double > >(
+                            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+
+            // round trip at fixed epoch, inverse transformation has negated parameters
+            auto forward = Helmert::create( helmert_config, georef.scale_factor ).at( 2020 );
+            auto backward = Helmert::create( helmert_config.inverse(), georef.scale_factor ).at( 2020 );
+            timer = std::chrono::steady_clock::now();
+            context.transform( georef, HelmertGeod2Topo{ forward, nullptr } );
+            context.download();
+            auto back = BufferPool::global().acquire< double >( count * 3 );
+            std::copy( result.begin(), result.end(), back.begin() );
+            transform( georef, PointView{ back.data(), count }, HelmertTopo2Geod{ backward, nullptr } );
+
+            double horizontal = 0, vertical = 0;
+            for ( uint32_t i = 0; i < count; i++ ) {
+                auto longitude = std::remainder( back[ i ] - storage[ i ], 360. ) * std::cos( storage[ i + count ] * radian );
+                auto latitude = back[ i + count ] - storage[ i + count ];
+                horizontal = std::max( { horizontal, std::abs( longitude ), std::abs( latitude ) } );
+                vertical = std::max( vertical, std::abs( back[ i + count * 2 ] - storage[ i + count * 2 ] ) );
+            }
+            std::cout << "helmert round trip: " << horizontal * radian * 6378137. << "m " << vertical << "m "
+                    << std::chrono::duration_cast< std::chrono::duration< double > >(
+                            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+        }
+    }
+
+    if ( !export_path.empty() ) {
+        auto timer = std::chrono::steady_clock::now();
+        TextExporter( export_config ).write( export_path, storage.data(), count );
+        std::cout << "export " << export_path << ": " << std::chrono::duration_cast< std::chrono::duration< double > >(
                 std::chrono::steady_clock::now() - timer ).count() << "s\n";
     }
 
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <async.hpp>
+#include <buffer_pool.hpp>
+#include <dispatch.hpp>
+#include <geoid_grid.hpp>
+#include <statistics.hpp>
+
+#include "georef.hpp"
+
+/**
+ * applies pipeline( georef, point [, i ] ) to source points and stores them to result, bounds and sums of result
+ * are reduced in the same kernel when statistics is set, arrays are expected to be mapped already when offload is true
+ */
+template< typename Pipeline >
+void transform_kernel( Georef& georef, const double* source, double* result, uint32_t count, Pipeline pipeline,
+        Statistics* statistics, bool offload ) {
+    if ( !statistics ) {
+        #pragma omp target if(target: offload) map(to: georef, pipeline)
+        #pragma omp teams distribute parallel for firstprivate(georef, pipeline)
+        for ( uint32_t i = 0; i < count; i++ )
+            transform_point( pipeline, georef, source, result, count, i );
+        return;
+    }
+
+    auto identity = Statistics::create();
+    double min_x = identity.min[ 0 ], min_y = identity.min[ 1 ], min_z = identity.min[ 2 ];
+    double max_x = identity.max[ 0 ], max_y = identity.max[ 1 ], max_z = identity.max[ 2 ];
+    double sum_x = 0, sum_y = 0, sum_z = 0;
+
+    #pragma omp target if(target: offload) map(to: georef, pipeline) \
+            map(tofrom: min_x, min_y, min_z, max_x, max_y, max_z, sum_x, sum_y, sum_z)
+    #pragma omp teams distribute parallel for firstprivate(georef, pipeline) \
+            reduction(min: min_x, min_y, min_z) reduction(max: max_x, max_y, max_z) reduction(+: sum_x, sum_y, sum_z)
+    for ( uint32_t i = 0; i < count; i++ ) {
+        auto point = transform_point( pipeline, georef, source, result, count, i );
+        min_x = min_x < point.x() ? min_x : point.x();
+        min_y = min_y < point.y() ? min_y : point.y();
+        min_z = min_z < point.z() ? min_z : point.z();
+        max_x = max_x > point.x() ? max_x : point.x();
+        max_y = max_y > point.y() ? max_y : point.y();
+        max_z = max_z > point.z() ? max_z : point.z();
+        sum_x += point.x();
+        sum_y += point.y();
+        sum_z += point.z();
+    }
+
+    *statistics = Statistics{ { min_x, min_y, min_z }, { max_x, max_y, max_z }, { sum_x, sum_y, sum_z }, count };
+}
+
+/**
+ * maps view to device, applies pipeline( georef, point [, i ] ) to every point and maps it back,
+ * runs on host threads without mapping when offload is false
+ */
+template< typename Pipeline >
+void transform( Georef& georef, PointView view, Pipeline pipeline, bool offload = true ) {
+    auto data = view.data;
+    auto size = size_t( view.count ) * 3;
+
+    #pragma omp target data if(offload) map(tofrom: data[:size])
+    transform_kernel( georef, data, data, view.count, pipeline, nullptr, offload );
+}
+
+/**
+ * transform with bounds and sums of transformed points reduced in the same kernel
+ */
+template< typename Pipeline >
+void transform( Georef& georef, PointView view, Pipeline pipeline, Statistics& statistics, bool offload = true ) {
+    auto data = view.data;
+    auto size = size_t( view.count ) * 3;
+
+    #pragma omp target data if(offload) map(tofrom: data[:size])
+    transform_kernel( georef, data, data, view.count, pipeline, &statistics, offload );
+}
+
+/**
+ * host thread owning blocking target regions of asynchronous transforms
+ */
+inline Worker& offload_worker() {
+    static Worker worker;
+    return worker;
+}
+
+/**
+ * queues transform on offload worker, view must stay valid until completion is ready
+ */
+template< typename Pipeline >
+Completion transform_async( Georef& georef, PointView view, Pipeline pipeline, bool offload = true ) {
+    return offload_worker().submit( [georef, view, pipeline, offload]() mutable {
+        transform( georef, view, pipeline, offload );
+    } );
+}
+
+/**
+ * queued transform with statistics, view and statistics must stay valid until completion is ready
+ */
+template< typename Pipeline >
+Completion transform_async( Georef& georef, PointView view, Pipeline pipeline, Statistics& statistics, bool offload = true ) {
+    return offload_worker().submit( [georef, view, pipeline, &statistics, offload]() mutable {
+        transform( georef, view, pipeline, statistics, offload );
+    } );
+}
+
+/**
+ * routes each batch to the path with lower predicted cost, device path is calibrated as serve runs it,
+ * on a buffer mapped once where a batch costs only updates to and from device around the kernel,
+ * threshold is the crossover size reported for information
+ */
+struct Dispatcher {
+    CostModel host;
+    CostModel device;
+    uint32_t threshold;
+
+    static Dispatcher create( Georef& georef ) {
+        constexpr uint32_t small_count = 1 << 10;
+        constexpr uint32_t large_count = 1 << 18;
+        auto storage = BufferPool::global().acquire< double >( large_count * 3 );
+        std::fill( storage.begin(), storage.end(), 0. );
+        auto data = storage.data();
+        auto capacity = size_t( large_count ) * 3;
+
+        Dispatcher dispatcher;
+        dispatcher.host = CostModel::measure( [&]( uint32_t count ) {
+            transform( georef, PointView{ data, count }, Geod2Topo{}, false );
+        }, small_count, large_count );
+        dispatcher.device = dispatcher.host;
+        dispatcher.threshold = std::numeric_limits< uint32_t >::max();
+        if ( omp_get_num_devices() == 0 )
+            return dispatcher;
+
+        #pragma omp target enter data map(to: georef) map(alloc: data[:capacity])
+        dispatcher.device = CostModel::measure( [&]( uint32_t count ) {
+            auto size = size_t( count ) * 3;
+            #pragma omp target update to(data[:size])
+            transform_kernel( georef, data, data, count, Geod2Topo{}, nullptr, true );
+            #pragma omp target update from(data[:size])
+        }, small_count, large_count );
+        #pragma omp target exit data map(delete: data[:capacity], georef)
+
+        dispatcher.threshold = crossover( dispatcher.host, dispatcher.device );
+        return dispatcher;
+    }
+
+    bool offload( uint32_t count ) const {
+        return device.predict( count ) < host.predict( count );
+    }
+};
+
+/**
+ * device copies of source points, transform result and georef constants kept mapped between calls,
+ * only ranges marked dirty are sent to device and only requested ranges are read back,
+ * always runs on device, batches chosen by Dispatcher for host go through transform instead
+ */
+class DeviceContext {
+public:
+    DeviceContext( PointView source, PointView result ) : source( source ), result( result ), constants( &resident ) {
+        auto source_data = source.data;
+        auto result_data = result.data;
+        auto size = size_t( source.count ) * 3;
+        auto constants = this->constants;
+
+        #pragma omp target enter data map(to: source_data[:size]) map(alloc: constants[:1])
+        if ( result_data != source_data ) {
+            #pragma omp target enter data map(alloc: result_data[:size])
+        }
+    }
+
+    DeviceContext( const DeviceContext& ) = delete;
+    DeviceContext& operator=( const DeviceContext& ) = delete;
+
+    ~DeviceContext() {
+        auto source_data = source.data;
+        auto result_data = result.data;
+        auto size = size_t( source.count ) * 3;
+        auto constants = this->constants;
+
+        if ( result_data != source_data ) {
+            #pragma omp target exit data map(delete: result_data[:size])
+        }
+        #pragma omp target exit data map(delete: source_data[:size], constants[:1])
+    }
+
+    /**
+     * schedules upload of source points [ begin, begin + count ) before next transform
+     */
+    void mark_dirty( uint32_t begin, uint32_t count ) {
+        dirty.push_back( { begin, count } );
+    }
+
+    template< typename Pipeline >
+    void transform( const Georef& georef, Pipeline pipeline ) {
+        upload( georef );
+        transform_kernel( *constants, source.data, result.data, source.count, pipeline, nullptr, true );
+    }
+
+    /**
+     * transform with bounds and sums of result reduced in the same kernel
+     */
+    template< typename Pipeline >
+    void transform( const Georef& georef, Pipeline pipeline, Statistics& statistics ) {
+        upload( georef );
+        transform_kernel( *constants, source.data, result.data, source.count, pipeline, &statistics, true );
+    }
+
+    /**
+     * reads back result points [ begin, begin + count )
+     */
+    void download( uint32_t begin, uint32_t count ) {
+        auto x = result.data + begin;
+        auto y = x + result.count;
+        auto z = y + result.count;
+        #pragma omp target update from(x[:count], y[:count], z[:count])
+    }
+
+    void download() {
+        download( 0, result.count );
+    }
+
+private:
+    /**
+     * sends dirty source ranges and georef constants to device
+     */
+    void upload( const Georef& georef ) {
+        auto stride = source.count;
+        for ( auto& range : dirty ) {
+            auto x = source.data + range.first;
+            auto y = x + stride;
+            auto z = y + stride;
+            auto count = range.second;
+            #pragma omp target update to(x[:count], y[:count], z[:count])
+        }
+        dirty.clear();
+
+        auto constants = this->constants;
+        resident = georef;
+        #pragma omp target update to(constants[:1])
+    }
+
+    PointView source;
+    PointView result;
+    Georef resident;
+    Georef* constants;
+    std::vector< std::pair< uint32_t, uint32_t > > dirty;
+};
+
+/**
+ * geoid grid nodes copied to device once, view selects host or device copy of nodes
+ */
+class DeviceGeoid {
+public:
+    explicit DeviceGeoid( const GeoidGrid& grid ) : node_count( grid.header().node_count() ) {
+        auto& header = grid.header();
+        auto nodes = grid.nodes();
+        auto size = node_count;
+        host = Geoid{ nodes, header.rows, header.cols, header.tile_size, header.tile_cols(),
+                header.lon0, header.lat0, header.step, 360. / header.step };
+        device = host;
+
+        #pragma omp target enter data map(to: nodes[:size])
+        #pragma omp target data use_device_ptr(nodes)
+        {
+            device.nodes = nodes;
+        }
+    }
+
+    DeviceGeoid( const DeviceGeoid& ) = delete;
+    DeviceGeoid& operator=( const DeviceGeoid& ) = delete;
+
+    ~DeviceGeoid() {
+        auto nodes = host.nodes;
+        auto size = node_count;
+        #pragma omp target exit data map(delete: nodes[:size])
+    }
+
+    Geoid view( bool offload ) const {
+        return offload ? device : host;
+    }
+
+private:
+    Geoid host;
+    Geoid device;
+    size_t node_count;
+};
+
+/**
+ * per point epochs copied to device once, view selects host or device copy
+ */
+class DeviceEpochs {
+public:
+    DeviceEpochs( const double* epochs, uint32_t count ) : host( epochs ), device( epochs ), count( count ) {
+        #pragma omp target enter data map(to: epochs[:count])
+        #pragma omp target data use_device_ptr(epochs)
+        {
+            device = epochs;
+        }
+    }
+
+    DeviceEpochs( const DeviceEpochs& ) = delete;
+    DeviceEpochs& operator=( const DeviceEpochs& ) = delete;
+
+    ~DeviceEpochs() {
+        auto epochs = host;
+        auto count = this->count;
+        #pragma omp target exit data map(delete: epochs[:count])
+    }
+
+    const double* view( bool offload ) const {
+        return offload ? device : host;
+    }
+
+private:
+    const double* host;
+    const double* device;
+    uint32_t count;
+};
@@ -4,9 +4,31 @@
 #include <vector>
 #include <chrono>
 #include <cmath>
+#include <string>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <stdexcept>
+#include <mutex>
+#include <thread>
 
 #include <CL/sycl.hpp>
 
+#include <async.hpp>
+#include <buffer_pool.hpp>
+#include <dispatch.hpp>
+#include <geoid_grid.hpp>
+#include <helmert.hpp>
+#include <parallel.hpp>
+#include <pipelines.hpp>
+#include <statistics.hpp>
+#include <spatial_index.hpp>
+#include <text_export.hpp>
+#include <transform_server.hpp>
+
 constexpr double radian = M_PI / 180.;
 constexpr double degree = 1 / radian;
 
@@ -103,6 +125,51 @@ struct Point3 {
     }
 };
 
+/**
+ * tiled geoid undulation grid, see geoid_grid.hpp for layout
+ */
+struct Geoid {
+    const float* nodes;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t tile_size;
+    uint32_t tile_cols;
+    double lon0;
+    double lat0;
+    double step;
+    double period;
+
+    float node( uint32_t row, uint32_t col ) const {
+        auto tile = size_t( row / tile_size ) * tile_cols + col / tile_size;
+        return nodes[ ( tile * tile_size + row % tile_size ) * tile_size + col % tile_size ];
+    }
+
+    /**
+     * bilinear interpolation in degrees, longitude of global grid wraps around every period = 360 / step nodes,
+     * so grids repeating 0 / 360 column are read from their first period, regional grid narrower than period
+     * is wrapped around its middle and clamped like latitude
+     */
+    double undulation( double longitude, double latitude ) const {
+        auto global = cols + 1e-6 >= period;
+        auto u = ( longitude - lon0 ) / step;
+        auto v = ( latitude - lat0 ) / step;
+        auto start = select( global, 0., ( cols - 1 ) / 2. - period / 2 );
+        u -= sycl::floor( ( u - start ) / period ) * period;
+        u = select( global, u, sycl::clamp( u, 0., double( cols - 1 ) ) );
+        v = sycl::clamp( v, 0., double( rows - 1 ) );
+        auto col = uint32_t( u );
+        auto row = uint32_t( v );
+        auto du = u - col;
+        auto dv = v - row;
+        col = select( col >= cols, select( global, 0u, cols - 1 ), col );
+        auto next_col = select( col + 1 >= cols, select( global, 0u, col ), col + 1 );
+        auto next_row = select( row + 1 >= rows, row, row + 1 );
+        auto south = node( row, col ) * ( 1 - du ) + node( row, next_col ) * du;
+        auto north = node( next_row, col ) * ( 1 - du ) + node( next_row, next_col ) * du;
+        return south * ( 1 - dv ) + north * dv;
+    }
+};
+
 /**
  *
  */
@@ -195,6 +262,47 @@ struct Georef {
         return *this;
     }
 
+    /**
+     * projection epsg:4326 with orthometric height to epsg:4978
+     */
+    template< typename Object >
+    auto& geod2ecef( Object& object, const Geoid& geoid ) const {
+        object.z() += geoid.undulation(
+                origin.x() + ( object.x() - origin.x() ) * scale_factor,
+                origin.y() + ( object.y() - origin.y() ) * scale_factor );
+        return geod2ecef( object );
+    }
+
+    /**
+     * projection epsg:4978 to epsg:4326 with orthometric height
+     */
+    template< typename Object >
+    auto& ecef2geod( Object& object, const Geoid& geoid ) const {
+        ecef2geod( object );
+        object.z() -= geoid.undulation(
+                origin.x() + ( object.x() - origin.x() ) * scale_factor,
+                origin.y() + ( object.y() - origin.y() ) * scale_factor );
+        return *this;
+    }
+
+    /**
+     * datum shift in epsg:4978 at reference epoch of helmert
+     */
+    template< typename Object >
+    auto& ecef2ecef( Object& object, const Helmert& helmert ) const {
+        helmert.apply( object );
+        return *this;
+    }
+
+    /**
+     * datum shift in epsg:4978 at epoch of point
+     */
+    template< typename Object >
+    auto& ecef2ecef( Object& object, const Helmert& helmert, double epoch ) const {
+        helmert.apply( object, epoch );
+        return *this;
+    }
+
     /**
      * projection epsg:4978 to epsg:5819
      */
@@ -225,33 +333,528 @@ struct Georef {
 };
 
 /**
- *
+ * calls pipeline( georef, point, i ) for pipelines reading per point arrays, pipeline( georef, point ) otherwise
+ */
+template< typename Pipeline, typename Object >
+inline void apply_pipeline( const Pipeline& pipeline, const Georef& georef, Object& object, uint32_t i ) {
+    if constexpr ( std::is_invocable_v< const Pipeline&, const Georef&, Object&, uint32_t > )
+        pipeline( georef, object, i );
+    else
+        pipeline( georef, object );
+}
+
+/**
+ * applies pipeline to point i of source and stores it to result, both stored as x[count] y[count] z[count]
+ */
+template< typename Pipeline, typename Source, typename Result >
+inline Point3< double > transform_point( const Pipeline& pipeline, const Georef& georef, const Source& source, const Result& result,
+        uint32_t count, uint32_t i ) {
+    uint32_t xi = i;
+    uint32_t yi = i + count;
+    uint32_t zi = i + count * 2;
+    auto point = Point3< double >::create( source[ xi ], source[ yi ], source[ zi ] );
+    apply_pipeline( pipeline, georef, point, i );
+    result[ xi ] = point.x();
+    result[ yi ] = point.y();
+    result[ zi ] = point.z();
+    return point;
+}
+
+/**
+ * adds kernel applying pipeline( georef, point [, i ] ) to source points and storing them to result,
+ * when reduced is set bounds and sums of result are reduced in the same kernel to reduced[ 9 ] as min, max and sum
+ */
+template< typename Pipeline, typename Source, typename Result >
+void transform_kernel( sycl::handler& cgh, const Georef& georef, Source source, Result result, uint32_t count,
+        Pipeline pipeline, double* reduced ) {
+    if ( !reduced ) {
+        cgh.parallel_for( sycl::range< 1 >{ count }, [=]( sycl::item< 1 > i ) {
+            transform_point( pipeline, georef, source, result, count, i );
+        } );
+        return;
+    }
+
+    auto min = sycl::span< double, 3 >( reduced, 3 );
+    auto max = sycl::span< double, 3 >( reduced + 3, 3 );
+    auto sum = sycl::span< double, 3 >( reduced + 6, 3 );
+    auto initialize = sycl::property_list{ sycl::property::reduction::initialize_to_identity{} };
+
+    cgh.parallel_for( sycl::range< 1 >{ count },
+            sycl::reduction( min, sycl::minimum< double >(), initialize ),
+            sycl::reduction( max, sycl::maximum< double >(), initialize ),
+            sycl::reduction( sum, sycl::plus< double >(), initialize ),
+            [=]( sycl::item< 1 > i, auto& min, auto& max, auto& sum ) {
+        auto point = transform_point( pipeline, georef, source, result, count, i );
+        for ( int axis = 0; axis < 3; axis++ ) {
+            min[ axis ].combine( point.storage[ axis ] );
+            max[ axis ].combine( point.storage[ axis ] );
+            sum[ axis ].combine( point.storage[ axis ] );
+        }
+    } );
+}
+
+/**
+ * statistics of count points from reduced[ 9 ] filled by transform_kernel
+ */
+inline Statistics reduced_statistics( const double* reduced, uint32_t count ) {
+    return Statistics{ { reduced[ 0 ], reduced[ 1 ], reduced[ 2 ] }, { reduced[ 3 ], reduced[ 4 ], reduced[ 5 ] },
+            { reduced[ 6 ], reduced[ 7 ], reduced[ 8 ] }, count };
+}
+
+/**
+ * applies pipeline on host threads to points stored as x[count] y[count] z[count],
+ * bounds and sums of result are gathered into statistics when it is set
+ */
+template< typename Pipeline >
+void transform_host( const Georef& georef, double* data, uint32_t count, Pipeline pipeline, Statistics* statistics = nullptr ) {
+    std::mutex mutex;
+    if ( statistics )
+        *statistics = Statistics::create();
+    parallel_ranges( count, std::max( std::thread::hardware_concurrency(), 1u ), [&]( uint32_t begin, uint32_t end ) {
+        auto local = Statistics::create();
+        for ( auto i = begin; i < end; i++ ) {
+            auto point = transform_point( pipeline, georef, data, data, count, i );
+            if ( statistics )
+                local.add( point.storage );
+        }
+        if ( statistics ) {
+            std::lock_guard< std::mutex > lock( mutex );
+            statistics->merge( local );
+        }
+    } );
+}
+
+/**
+ * applies pipeline( georef, point [, i ] ) to points stored as x[count] y[count] z[count],
+ * when offload is false points are transformed by host task on host threads, see Dispatcher
+ */
+template< typename Pipeline >
+sycl::event transform( sycl::queue& queue, const Georef& georef, sycl::buffer< double, 1 >& storage, Pipeline pipeline,
+        bool offload = true ) {
+    uint32_t count = storage.size() / 3;
+    return queue.submit( [&]( sycl::handler& cgh ) {
+        if ( !offload ) {
+            sycl::accessor data{ storage, cgh, sycl::read_write, sycl::host_task };
+            cgh.host_task( [=] {
+                transform_host( georef, &data[ 0 ], count, pipeline );
+            } );
+            return;
+        }
+        auto data = storage.get_access< sycl::access::mode::read_write >( cgh );
+        transform_kernel( cgh, georef, data, data, count, pipeline, nullptr );
+    } );
+}
+
+/**
+ * transform with bounds and sums of transformed points reduced in the same kernel,
+ * statistics is written by host task ordered after kernel and must stay alive until returned event completes
+ */
+template< typename Pipeline >
+sycl::event transform( sycl::queue& queue, const Georef& georef, sycl::buffer< double, 1 >& storage, Pipeline pipeline,
+        Statistics& statistics, bool offload = true ) {
+    uint32_t count = storage.size() / 3;
+    if ( !offload ) {
+        return queue.submit( [&]( sycl::handler& cgh ) {
+            sycl::accessor data{ storage, cgh, sycl::read_write, sycl::host_task };
+            cgh.host_task( [=, &statistics] {
+                transform_host( georef, &data[ 0 ], count, pipeline, &statistics );
+            } );
+        } );
+    }
+
+    auto reduced = sycl::malloc_shared< double >( 9, queue );
+    auto kernel = queue.submit( [&]( sycl::handler& cgh ) {
+        auto data = storage.get_access< sycl::access::mode::read_write >( cgh );
+        transform_kernel( cgh, georef, data, data, count, pipeline, reduced );
+    } );
+    return queue.submit( [&]( sycl::handler& cgh ) {
+        cgh.depends_on( kernel );
+        cgh.host_task( [reduced, count, &statistics, context = queue.get_context()] {
+            statistics = reduced_statistics( reduced, count );
+            sycl::free( reduced, context );
+        } );
+    } );
+}
+
+/**
+ * completion polls event status
+ */
+inline Completion event_completion( sycl::event event ) {
+    return Completion( [event] {
+        return event.get_info< sycl::info::event::command_execution_status >() ==
+                sycl::info::event_command_status::complete;
+    } );
+}
+
+/**
+ * completion polls kernel event, storage must stay alive until completion is ready
+ */
+template< typename Pipeline >
+Completion transform_async( sycl::queue& queue, const Georef& georef, sycl::buffer< double, 1 >& storage, Pipeline pipeline,
+        bool offload = true ) {
+    return event_completion( transform( queue, georef, storage, pipeline, offload ) );
+}
+
+/**
+ * asynchronous transform with statistics, storage and statistics must stay alive until completion is ready
+ */
+template< typename Pipeline >
+Completion transform_async( sycl::queue& queue, const Georef& georef, sycl::buffer< double, 1 >& storage, Pipeline pipeline,
+        Statistics& statistics, bool offload = true ) {
+    return event_completion( transform( queue, georef, storage, pipeline, statistics, offload ) );
+}
+
+/**
+ * copies host points to device scratch, applies pipeline there and copies them back
  */
-class CudaSelector : public sycl::device_selector {
+template< typename Pipeline >
+void transform_device( sycl::queue& queue, const Georef& georef, double* scratch, double* data, uint32_t count, Pipeline pipeline ) {
+    auto size = size_t( count ) * 3 * sizeof( double );
+    queue.memcpy( scratch, data, size );
+    queue.submit( [&]( sycl::handler& cgh ) {
+        transform_kernel( cgh, georef, scratch, scratch, count, pipeline, nullptr );
+    } );
+    queue.memcpy( data, scratch, size );
+    queue.wait();
+}
+
+/**
+ * routes each batch to the path with lower predicted cost, device path is calibrated with transform_device
+ * as serve runs it, threshold is the crossover size reported for information
+ */
+struct Dispatcher {
+    CostModel host;
+    CostModel device;
+    uint32_t threshold;
+
+    static Dispatcher create( sycl::queue& queue, const Georef& georef ) {
+        constexpr uint32_t small_count = 1 << 10;
+        constexpr uint32_t large_count = 1 << 18;
+        auto storage = BufferPool::global().acquire< double >( large_count * 3 );
+        auto scratch = sycl::malloc_device< double >( large_count * 3, queue );
+        std::fill( storage.begin(), storage.end(), 0. );
+
+        Dispatcher dispatcher;
+        dispatcher.host = CostModel::measure( [&]( uint32_t count ) {
+            transform_host( georef, storage.data(), count, Geod2Topo{} );
+        }, small_count, large_count );
+        dispatcher.device = CostModel::measure( [&]( uint32_t count ) {
+            transform_device( queue, georef, scratch, storage.data(), count, Geod2Topo{} );
+        }, small_count, large_count );
+        dispatcher.threshold = crossover( dispatcher.host, dispatcher.device );
+
+        sycl::free( scratch, queue );
+        return dispatcher;
+    }
+
+    bool offload( uint32_t count ) const {
+        return device.predict( count ) < host.predict( count );
+    }
+};
+
+/**
+ * device copies of source points and transform result kept allocated between calls,
+ * only ranges marked dirty are sent to device and only requested ranges are read back,
+ * always runs on device, batches chosen by Dispatcher for host go through transform instead
+ */
+class DeviceContext {
 public:
-    int operator()( const sycl::device& device ) const override {
-        if ( device.get_platform().get_backend() == sycl::backend::ext_oneapi_cuda ) {
-            std::cout << "Cuda device found" << std::endl;
-            return 1;
+    DeviceContext( sycl::queue& queue, const double* source, double* result, uint32_t count )
+            : queue( queue ), source( source ), result( result ), count( count ) {
+        device_source = sycl::malloc_device< double >( size_t( count ) * 3, queue );
+        device_result = sycl::malloc_device< double >( size_t( count ) * 3, queue );
+        queue.memcpy( device_source, source, size_t( count ) * 3 * sizeof( double ) );
+    }
+
+    DeviceContext( const DeviceContext& ) = delete;
+    DeviceContext& operator=( const DeviceContext& ) = delete;
+
+    ~DeviceContext() {
+        queue.wait();
+        sycl::free( device_source, queue );
+        sycl::free( device_result, queue );
+    }
+
+    /**
+     * uploads source points [ begin, begin + size ) before next transform
+     */
+    void mark_dirty( uint32_t begin, uint32_t size ) {
+        for ( size_t axis = 0; axis < 3; axis++ ) {
+            auto offset = begin + axis * count;
+            queue.memcpy( device_source + offset, source + offset, size * sizeof( double ) );
         }
-        return -1;
     }
+
+    template< typename Pipeline >
+    sycl::event transform( const Georef& georef, Pipeline pipeline ) {
+        return queue.submit( [&]( sycl::handler& cgh ) {
+            transform_kernel( cgh, georef, static_cast< const double* >( device_source ), device_result, count, pipeline, nullptr );
+        } );
+    }
+
+    /**
+     * transform with bounds and sums of result reduced in the same kernel
+     */
+    template< typename Pipeline >
+    void transform( const Georef& georef, Pipeline pipeline, Statistics& statistics ) {
+        auto reduced = sycl::malloc_shared< double >( 9, queue );
+        queue.submit( [&]( sycl::handler& cgh ) {
+            transform_kernel( cgh, georef, static_cast< const double* >( device_source ), device_result, count, pipeline, reduced );
+        } ).wait();
+
+        statistics = reduced_statistics( reduced, count );
+        sycl::free( reduced, queue );
+    }
+
+    /**
+     * reads back result points [ begin, begin + size )
+     */
+    void download( uint32_t begin, uint32_t size ) {
+        for ( size_t axis = 0; axis < 3; axis++ ) {
+            auto offset = begin + axis * count;
+            queue.memcpy( result + offset, device_result + offset, size * sizeof( double ) );
+        }
+        queue.wait();
+    }
+
+    void download() {
+        download( 0, count );
+    }
+
+private:
+    sycl::queue& queue;
+    const double* source;
+    double* result;
+    double* device_source;
+    double* device_result;
+    uint32_t count;
 };
 
 /**
- *
+ * geoid grid nodes copied to device memory once, view selects host or device copy of nodes
  */
-class OpenclSelector : public sycl::device_selector {
+class DeviceGeoid {
 public:
-    int operator()( const sycl::device& device ) const override {
-        if ( device.get_platform().get_backend() == sycl::backend::opencl ) {
-            std::cout << "Opencl device found" << std::endl;
-            return 1;
+    DeviceGeoid( sycl::queue& queue, const GeoidGrid& grid ) : queue( queue ) {
+        auto& header = grid.header();
+        host = Geoid{ grid.nodes(), header.rows, header.cols, header.tile_size, header.tile_cols(),
+                header.lon0, header.lat0, header.step, 360. / header.step };
+        device = host;
+
+        auto nodes = sycl::malloc_device< float >( header.node_count(), queue );
+        queue.memcpy( nodes, grid.nodes(), header.node_count() * sizeof( float ) ).wait();
+        device.nodes = nodes;
+    }
+
+    DeviceGeoid( const DeviceGeoid& ) = delete;
+    DeviceGeoid& operator=( const DeviceGeoid& ) = delete;
+
+    ~DeviceGeoid() {
+        sycl::free( const_cast< float* >( device.nodes ), queue );
+    }
+
+    Geoid view( bool offload ) const {
+        return offload ? device : host;
+    }
+
+private:
+    sycl::queue& queue;
+    Geoid host;
+    Geoid device;
+};
+
+/**
+ * per point epochs copied to device memory once, view selects host or device copy
+ */
+class DeviceEpochs {
+public:
+    DeviceEpochs( sycl::queue& queue, const double* epochs, uint32_t count ) : queue( queue ), host( epochs ) {
+        auto copy = sycl::malloc_device< double >( count, queue );
+        queue.memcpy( copy, epochs, size_t( count ) * sizeof( double ) ).wait();
+        device = copy;
+    }
+
+    DeviceEpochs( const DeviceEpochs& ) = delete;
+    DeviceEpochs& operator=( const DeviceEpochs& ) = delete;
+
+    ~DeviceEpochs() {
+        sycl::free( const_cast< double* >( device ), queue );
+    }
+
+    const double* view( bool offload ) const {
+        return offload ? device : host;
+    }
+
+private:
+    sycl::queue& queue;
+    const double* host;
+    const double* device;
+};
+
+/**
+ * device chosen by throughput of geod2ecef / ecef2geod calibration kernel among cuda, opencl and cpu devices,
+ * choice is cached in $XDG_CACHE_HOME/offload_test/sycl_device and calibration is skipped while cached device exists
+ */
+class CalibratedSelector : public sycl::device_selector {
+public:
+    explicit CalibratedSelector( const Georef& georef ) {
+        auto devices = sycl::device::get_devices();
+        if ( load( devices ) )
+            return;
+
+        double best = 0;
+        for ( auto& device : devices ) {
+            if ( !device.has( sycl::aspect::fp64 ) )
+                continue;
+
+            auto backend = device.get_platform().get_backend();
+            if ( backend != sycl::backend::ext_oneapi_cuda && backend != sycl::backend::opencl && !device.is_cpu() )
+                continue;
+
+            try {
+                auto throughput = calibrate( device, georef );
+                std::cout << describe( device ) << ": " << throughput * 1e-6 << " Mpt/s" << std::endl;
+                if ( throughput > best ) {
+                    best = throughput;
+                    chosen = describe( device );
+                }
+            } catch ( const sycl::exception& e ) {
+                std::cout << describe( device ) << ": " << e.what() << std::endl;
+            }
         }
-        return -1;
+
+        if ( chosen.empty() )
+            throw std::runtime_error( "no sycl device with fp64 support" );
+        save();
+    }
+
+    int operator()( const sycl::device& device ) const override {
+        return describe( device ) == chosen ? 1 : -1;
+    }
+
+private:
+    static std::string describe( const sycl::device& device ) {
+        std::ostringstream stream;
+        stream << device.get_platform().get_backend() << ":" << device.get_info< sycl::info::device::name >();
+        return stream.str();
+    }
+
+    static std::string cache_path() {
+        if ( auto path = std::getenv( "XDG_CACHE_HOME" ) )
+            return std::string( path ) + "/offload_test/sycl_device";
+        if ( auto path = std::getenv( "HOME" ) )
+            return std::string( path ) + "/.cache/offload_test/sycl_device";
+        return {};
+    }
+
+    /**
+     * points per second of short round trip batch, first run is excluded to skip kernel jit
+     */
+    static double calibrate( const sycl::device& device, const Georef& georef ) {
+        constexpr uint32_t count = 1 << 18;
+        constexpr int repeats = 3;
+        sycl::queue queue{ device, sycl::property::queue::in_order{} };
+        sycl::buffer< double, 1 > storage{ sycl::range< 1 >{ count * 3 } };
+
+        queue.submit( [&]( sycl::handler& cgh ) {
+            auto data = storage.get_access< sycl::access::mode::discard_write >( cgh );
+            cgh.parallel_for( sycl::range< 1 >{ count }, [=]( sycl::item< 1 > i ) {
+                uint32_t index = i;
+                data[ index ] = -180 + 360 * double( index ) / ( count - 1 );
+                data[ index + count ] = -90 + 180 * double( index ) / ( count - 1 );
+                data[ index + count * 2 ] = 0;
+            } );
+        } );
+        auto round_trip = [&] {
+            return transform( queue, georef, storage, []( const Georef& reference, auto& point ) {
+                reference.geod2ecef( point ).ecef2geod( point );
+            } );
+        };
+        round_trip().wait();
+
+        auto timer = std::chrono::steady_clock::now();
+        for ( int r = 0; r < repeats; r++ )
+            round_trip();
+        queue.wait_and_throw();
+        auto seconds = std::chrono::duration_cast< std::chrono::duration< double > >(
+                std::chrono::steady_clock::now() - timer ).count();
+        return double( count ) * repeats / seconds;
     }
+
+    bool load( const std::vector< sycl::device >& devices ) {
+        std::ifstream file( cache_path() );
+        if ( !file || !std::getline( file, chosen ) )
+            return false;
+
+        for ( auto& device : devices )
+            if ( describe( device ) == chosen )
+                return true;
+
+        chosen.clear();
+        return false;
+    }
+
+    void save() const {
+        auto path = cache_path();
+        if ( path.empty() )
+            return;
+
+        std::error_code error;
+        std::filesystem::create_directories( std::filesystem::path( path ).parent_path(), error );
+        std::ofstream( path ) << chosen << "\n";
+    }
+
+    std::string chosen;
 };
 
+/**
+ * round trip of storage through async transform with both directions fused in one kernel,
+ * bounds of result are reduced in the same kernel and should match input
+ */
+template< typename Pipeline >
+Task process( sycl::queue& queue, Georef georef, sycl::buffer< double, 1 >& storage, Pipeline round_trip, bool offload ) {
+    auto timer = std::chrono::steady_clock::now();
+
+    Statistics statistics;
+    co_await transform_async( queue, georef, storage, round_trip, statistics, offload );
+
+    std::cout << std::chrono::duration_cast< std::chrono::duration< double > >(
+            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+    std::cout << "  bounds: " << statistics.min[ 0 ] << " " << statistics.min[ 1 ] << " " << statistics.min[ 2 ]
+            << " - " << statistics.max[ 0 ] << " " << statistics.max[ 1 ] << " " << statistics.max[ 2 ] << "\n";
+}
+
+/**
+ * projects geodetic points to topocentric with batch buffer kept allocated on device
+ */
+template< typename Pipeline >
+void serve( sycl::queue& queue, const Georef& georef, const Dispatcher& dispatcher, const ServerConfig& config,
+        Pipeline host_pipeline, Pipeline device_pipeline ) {
+    auto capacity = size_t( config.max_batch ) * 3;
+    auto data = sycl::malloc_device< double >( capacity, queue );
+
+    TransformServer server( config );
+    std::cout << "serving on " << config.socket_path << "\n" << std::flush;
+
+    server.run( [&]( double* batch, uint32_t count ) {
+        if ( !dispatcher.offload( count ) ) {
+            transform_host( georef, batch, count, host_pipeline );
+            return;
+        }
+
+        auto size = size_t( count ) * 3;
+        if ( size > capacity ) {
+            sycl::free( data, queue );
+            capacity = size;
+            data = sycl::malloc_device< double >( capacity, queue );
+        }
+
+        transform_device( queue, georef, data, batch, count, device_pipeline );
+    } );
+
+    sycl::free( data, queue );
+}
+
 /**
  *
  */
@@ -260,9 +863,58 @@ int main( int argc, char* argv[] ) {
     auto georef = Georef::create( config );
     std::cout << std::fixed << std::setprecision( 3 );
 
+    auto queue = sycl::queue{ CalibratedSelector{ georef }, sycl::property::queue::in_order{} };
+    std::cout << "device: " << queue.get_device().get_info< sycl::info::device::name >() << "\n";
+
+    auto dispatcher = Dispatcher::create( queue, georef );
+    std::cout << "host cost: " << dispatcher.host.overhead * 1e6 << "us + " << dispatcher.host.per_point * 1e9 << "ns/pt\n";
+    std::cout << "device cost: " << dispatcher.device.overhead * 1e6 << "us + " << dispatcher.device.per_point * 1e9 << "ns/pt\n";
+    std::cout << "offload threshold: " << dispatcher.threshold << "\n";
+
+    std::unique_ptr< GeoidGrid > geoid_grid;
+    std::unique_ptr< DeviceGeoid > geoid;
+    std::string export_path;
+    auto export_config = ExportConfig::create();
+    while ( argc > 2 ) {
+        auto option = std::string( argv[ 1 ] );
+        if ( option == "--geoid" ) {
+            geoid_grid = std::make_unique< GeoidGrid >( argv[ 2 ] );
+            geoid = std::make_unique< DeviceGeoid >( queue, *geoid_grid );
+            std::cout << "geoid: " << argv[ 2 ] << "\n";
+        } else if ( option == "--export" ) {
+            export_path = argv[ 2 ];
+        } else if ( option == "--precision" ) {
+            export_config.precision = std::atoi( argv[ 2 ] );
+            if ( export_config.precision < 0 || export_config.precision > ExportConfig::max_precision ) {
+                std::cerr << "--precision must be in 0.." << ExportConfig::max_precision << "\n";
+                return 1;
+            }
+        } else {
+            break;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
+    if ( argc > 1 && std::string( argv[ 1 ] ) == "--serve" ) {
+        auto server_config = ServerConfig::create();
+        if ( argc > 2 )
+            server_config.socket_path = argv[ 2 ];
+        if ( argc > 3 )
+            server_config.deadline = std::chrono::microseconds( std::atol( argv[ 3 ] ) );
+        if ( argc > 4 )
+            server_config.max_batch = std::atol( argv[ 4 ] );
+        if ( geoid )
+            serve( queue, georef, dispatcher, server_config, OrthoGeod2Topo{ geoid->view( false ) }, OrthoGeod2Topo{ geoid->view( true ) } );
+        else
+            serve( queue, georef, dispatcher, server_config, Geod2Topo{}, Geod2Topo{} );
+        return 0;
+    }
+
     uint32_t count = 100'000'000;
-    sycl::buffer< double, 1 > storage { count * 3 };
-    auto queue = sycl::queue{ CudaSelector {} };
+    auto points = BufferPool::global().acquire< double >( count * 3 );
+    sycl::buffer< double, 1 > storage { points.data(), sycl::range< 1 >{ points.size() },
+            { sycl::property::buffer::use_host_ptr{} } };
 
     {
         auto data = storage.get_access< sycl::access::mode::write >();
@@ -273,30 +925,119 @@ int main( int argc, char* argv[] ) {
         for ( uint32_t i = 0; i < count; i++ )
             data[ i + count ] = -90 + 180 * double( i ) / ( count - 1 );
 
+        for ( uint32_t i = 0; i < count; i++ )
+            data[ i + count * 2 ] = 0;
+
         std::cout << "in:\n";
         for ( uint32_t i = 0; i < count; i += ( count - 1 ) / 2 )
             std::cout << data[ i ] << " " << data[ i + count ] << " " << data[ i + count * 2 ] << "\n";
     }
 
     {
-        auto range = sycl::range< 1 >{ count };
-        auto timer = std::chrono::steady_clock::now();
+        Executor executor;
+        auto offload = dispatcher.offload( count );
+        if ( geoid )
+            executor.spawn( process( queue, georef, storage, OrthoRoundTrip{ geoid->view( offload ) }, offload ) );
+        else
+            executor.spawn( process( queue, georef, storage, RoundTrip{}, offload ) );
+        executor.run();
+    }
 
-        queue.submit( [&]( sycl::handler& cgh ) {
-            auto data = storage.get_access< sycl::access::mode::read_write >( cgh );
-            cgh.parallel_for( range, [=]( sycl::item< 1 > i ) {
-                uint32_t xi = i;
-                uint32_t yi = i + count;
-                uint32_t zi = i + count * 2;
-                auto point = Point3< double >::create( data[ xi ], data[ yi ], data[ zi ] );
-                georef.geod2ecef( point ).ecef2topo( point ).topo2ecef( point ).ecef2geod( point );
-                data[ xi ] = point.x();
-                data[ yi ] = point.y();
-                data[ zi ] = point.z();
-            } );
-        } );
+    {
+        auto data = storage.get_access< sycl::access::mode::read >();
+        auto result = BufferPool::global().acquire< double >( count * 3 );
+        DeviceContext context( queue, points.data(), result.data(), count );
 
-        std::cout << std::chrono::duration_cast< std::chrono::duration< double > >(
+        for ( double longitude : { -90., 0., 90. } ) {
+            auto origin_config = config;
+            origin_config.origin_logitude = longitude;
+            auto timer = std::chrono::steady_clock::now();
+
+            Statistics statistics;
+            context.transform( Georef::create( origin_config ), Geod2Topo{}, statistics );
+            context.download( 0, 1 );
+
+            std::cout << "origin " << longitude << ": " << result[ 0 ] << " " << result[ count ] << " " << result[ count * 2 ] << " "
+                    << std::chrono::duration_cast< std::chrono::duration< double > >(
+                            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+            std::cout << "  bounds: " << statistics.min[ 0 ] << " " << statistics.min[ 1 ] << " " << statistics.min[ 2 ]
+                    << " - " << statistics.max[ 0 ] << " " << statistics.max[ 1 ] << " " << statistics.max[ 2 ] << "\n";
+            std::cout << "  centroid: " << statistics.centroid( 0 ) << " " << statistics.centroid( 1 ) << " " << statistics.centroid( 2 ) << "\n";
+        }
+
+        {
+            context.download();
+            auto timer = std::chrono::steady_clock::now();
+            auto index = SpatialIndex::build( result.data(), count, 10'000 );
+            std::cout << "index: " << index.cell_count() << " cells " << std::chrono::duration_cast< std::chrono::duration< double > >(
+                    std::chrono::steady_clock::now() - timer ).count() << "s\n";
+
+            // last origin longitude is 90, query around a point of the cloud rather than around origin
+            double center[ 3 ] = { result[ count / 4 ], result[ count / 4 + count ], result[ count / 4 + count * 2 ] };
+            timer = std::chrono::steady_clock::now();
+            auto inside = index.radius( center, 1'000'000 );
+            auto nearest = index.nearest( center, 10 );
+            std::cout << "  within 1000km: " << inside.size() << ", nearest: " << result[ nearest[ 0 ] ] << " "
+                    << result[ nearest[ 0 ] + count ] << " " << result[ nearest[ 0 ] + count * 2 ] << " "
+                    << std::chrono::duration_cast< std::chrono::duration< double > >(
+                            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+
+            std::cout << "  brute force mismatches: " << check_spatial_index( result.data(), count ) << "\n";
+        }
+
+        {
+            // itrf2014 to itrf2008
+            auto helmert_config = HelmertConfig::create();
+            helmert_config.tx = 0.0016;
+            helmert_config.ty = 0.0019;
+            helmert_config.tz = 0.0024;
+            helmert_config.scale = -0.02;
+            helmert_config.rate_tz = -0.0001;
+            helmert_config.rate_scale = 0.03;
+            helmert_config.reference_epoch = 2010;
+
+            auto epochs = BufferPool::global().acquire< double >( count );
+            for ( uint32_t i = 0; i < count; i++ )
+                epochs[ i ] = 2000 + 25 * double( i ) / ( count - 1 );
+            DeviceEpochs device_epochs( queue, epochs.data(), count );
+
+            Statistics plain, shifted;
+            auto timer = std::chrono::steady_clock::now();
+            context.transform( georef, Geod2Topo{}, plain );
+            context.transform( georef, HelmertGeod2Topo{ Helmert::create( helmert_config, georef.scale_factor ), device_epochs.view( true ) }, shifted );
+            std::cout << "helmert shift: " << shifted.centroid( 0 ) - plain.centroid( 0 ) << " "
+                    << shifted.centroid( 1 ) - plain.centroid( 1 ) << " " << shifted.centroid( 2 ) - plain.centroid( 2 ) << " "
+                    << std::chrono::duration_cast< std::chrono::duration< double > >(
+                            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+
+            // round trip at fixed epoch, inverse transformation has negated parameters
+            auto forward = Helmert::create( helmert_config, georef.scale_factor ).at( 2020 );
+            auto backward = Helmert::create( helmert_config.inverse(), georef.scale_factor ).at( 2020 );
+            timer = std::chrono::steady_clock::now();
+            context.transform( georef, HelmertGeod2Topo{ forward, nullptr } );
+            context.download();
+            auto back = BufferPool::global().acquire< double >( count * 3 );
+            std::copy( result.begin(), result.end(), back.begin() );
+            transform_host( georef, back.data(), count, HelmertTopo2Geod{ backward, nullptr } );
+
+            double horizontal = 0, vertical = 0;
+            for ( uint32_t i = 0; i < count; i++ ) {
+                auto longitude = std::remainder( back[ i ] - points[ i ], 360. ) * std::cos( points[ i + count ] * radian );
+                auto latitude = back[ i + count ] - points[ i + count ];
+                horizontal = std::max( { horizontal, std::abs( longitude ), std::abs( latitude ) } );
+                vertical = std::max( vertical, std::abs( back[ i + count * 2 ] - points[ i + count * 2 ] ) );
+            }
+            std::cout << "helmert round trip: " << horizontal * radian * 6378137. << "m " << vertical << "m "
+                    << std::chrono::duration_cast< std::chrono::duration< double > >(
+                            std::chrono::steady_clock::now() - timer ).count() << "s\n";
+        }
+    }
+
+    if ( !export_path.empty() ) {
+        auto data = storage.get_access< sycl::access::mode::read >();
+        auto timer = std::chrono::steady_clock::now();
+        TextExporter( export_config ).write( export_path, points.data(), count );
+        std::cout << "export " << export_path << ": " << std::chrono::duration_cast< std::chrono::duration< double > >(
                 std::chrono::steady_clock::now() - timer ).count() << "s\n";
     }
 